@@ -0,0 +1,31 @@
+#include "Aot.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+// Function-local static, as programs are registered during static initialisation of other translation units
+std::vector<const AotProgram *> &programs() {
+    static std::vector<const AotProgram *> registered;
+    return registered;
+}
+}
+
+bool registerAotProgram(const AotProgram &program) {
+    programs().push_back(&program);
+    return true;
+}
+
+std::size_t aotProgramCount() {
+    return programs().size();
+}
+
+const AotProgram *findAotProgram(const uint8_t *rom, std::size_t romSize) {
+    for (const auto *program : programs()) {
+        if (program->romSize == romSize && std::equal(rom, rom + romSize, program->rom)) {
+            return program;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Chip8;
+
+// A ROM translated to C++ ahead of time by chip8_aot. The generated source registers its program on startup, and the
+// AOT engine picks it up when a ROM with the same contents is loaded.
+struct AotProgram {
+    const uint8_t *rom; // Contents of the ROM the program was translated from
+    std::size_t romSize;
+    const uint8_t *code; // 1 for each byte of the ROM which belongs to a translated instruction, 0 for the rest
+
+    // Runs translated code from the current pc until the given number of instructions has been executed, or until it
+    // reaches an address which wasn't translated or has been modified since. Returns the number of executed
+    // instructions.
+    unsigned int (*run)(Chip8 &chip8, unsigned int cycles);
+};
+
+bool registerAotProgram(const AotProgram &program);
+
+[[nodiscard]] std::size_t aotProgramCount();
+
+// Returns the program translated from the given ROM, or nullptr if there is none
+[[nodiscard]] const AotProgram *findAotProgram(const uint8_t *rom, std::size_t romSize);
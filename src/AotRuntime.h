@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Chip8.h"
+#include "Execute.h"
+
+// The parts of Chip8 used by code generated by chip8_aot. Only included by generated sources.
+class AotRuntime {
+public:
+    static unsigned int execute(Chip8 &chip8, const Instruction &instruction) {
+        // The quirks are read at run time, so that one translation works with every set of quirks
+        return chip8.execute<RUNTIME_QUIRKS>(instruction);
+    }
+
+    static uint16_t pc(const Chip8 &chip8) {
+        return chip8.pc_;
+    }
+
+    // Whether any translated instruction currently differs from the ROM. Generated code then has to check every address
+    // it jumps to. Overwritten data doesn't count.
+    static bool modified(const Chip8 &chip8) {
+        return chip8.aotStaleCode_ != 0;
+    }
+
+    // Returns the pc if the instruction there still matches the ROM, or an address which is never translated
+    static unsigned int entry(const Chip8 &chip8) {
+        const unsigned int pc = chip8.pc_;
+        if (pc + 1 >= MEMORY_SIZE || chip8.aotStale_.test(pc) || chip8.aotStale_.test(pc + 1)) {
+            return MEMORY_SIZE;
+        }
+        return pc;
+    }
+};
@@ -1,16 +1,31 @@
 #include "Audio.h"
 
-#include <chrono>
+#include "Constants.h"
+
+#include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <thread>
 
-Audio::Audio(bool mute)
+Audio::Audio(bool mute, bool sync)
         : mute_{mute},
-          sineFreq_{500},
-          sampleFreq_{32000},
-          samplesPerSine_{sampleFreq_ / sineFreq_},
-          samplePos_{0} {
+          sync_{sync && !mute},
+          active_{false},
+          tonePos_{0},
+          pattern_{{}, DEFAULT_AUDIO_PITCH, false},
+          patternPos_{0},
+          queuedFrames_{},
+          framesQueued_{0},
+          framesPlayed_{0},
+          frameActive_{false},
+          frameSamplesLeft_{0},
+          framePlayed_{nullptr},
+          underruns_{0},
+          overruns_{0},
+          framesSinceStats_{0} {
+
+    for (unsigned int i = 0; i < AUDIO_TONE_SAMPLES; i++) {
+        tone_[i] = static_cast<uint8_t>((std::sin(i * M_PI * 2 / AUDIO_TONE_SAMPLES) + 1) * 127.5);
+    }
 
     if (mute_) {
         return;
@@ -20,22 +35,32 @@ Audio::Audio(bool mute)
         throw std::runtime_error("Failed to initialize SDL audio: " + std::string(SDL_GetError()));
     }
 
+    if (sync_) {
+        framePlayed_ = SDL_CreateSemaphore(0);
+        if (!framePlayed_) {
+            throw std::runtime_error("Failed to create the audio sync semaphore: " + std::string(SDL_GetError()));
+        }
+    }
+
     SDL_AudioSpec desiredSpec;
     SDL_AudioSpec obtainedSpec;
 
     SDL_zero(desiredSpec);
-    desiredSpec.freq = sampleFreq_;
+    desiredSpec.freq = AUDIO_SAMPLE_FREQUENCY;
     desiredSpec.format = AUDIO_U8;
     desiredSpec.channels = 1;
     desiredSpec.samples = 512;
     desiredSpec.callback = audioCallback;
     desiredSpec.userdata = this;
 
-    audioDevice_ = SDL_OpenAudioDevice(nullptr, 0, &desiredSpec, &obtainedSpec,
-                                       SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    // The callback always writes unsigned 8 bit samples at the desired rate, so SDL converts them if it has to
+    audioDevice_ = SDL_OpenAudioDevice(nullptr, 0, &desiredSpec, &obtainedSpec, 0);
     if (!audioDevice_) {
         throw std::runtime_error("Failed to open SDL audio device: " + std::string(SDL_GetError()));
     }
+
+    // The device runs from now on, and plays silence while the buzzer is off
+    SDL_PauseAudioDevice(audioDevice_, 0);
 }
 
 Audio::~Audio() {
@@ -43,40 +68,144 @@ Audio::~Audio() {
         SDL_CloseAudioDevice(audioDevice_);
         SDL_CloseAudio();
     }
+
+    if (framePlayed_) {
+        SDL_DestroySemaphore(framePlayed_);
+    }
 }
 
-void Audio::play() const {
+void Audio::update(bool active, const AudioPattern &pattern) {
+    const bool wasActive = active_.exchange(active, std::memory_order_relaxed);
+
     if (mute_) {
-        std::cout << "BEEP\n";
+        if (active && !wasActive) {
+            std::cout << "BEEP\n";
+        }
         return;
     }
 
-    auto playFunc = [&]() {
-        int duration = 75;
-        bool playing = true;
-        SDL_PauseAudioDevice(audioDevice_, 0);
+    setPattern(pattern);
+}
 
-        auto startCycleTime = std::chrono::high_resolution_clock::now();
-        while (playing) {
-            auto currentTime = std::chrono::high_resolution_clock::now();
-            auto timeSinceStart = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    currentTime - startCycleTime).count();
-            if (timeSinceStart >= duration) {
-                SDL_PauseAudioDevice(audioDevice_, 1);
-                playing = false;
-            }
+void Audio::queueFrame(bool active, const AudioPattern &pattern) {
+    setPattern(pattern);
+    framesSinceStats_++;
+
+    auto queued = framesQueued_.load(std::memory_order_relaxed);
+    const auto played = framesPlayed_.load(std::memory_order_acquire);
+
+    // Frames which have already been played still take their place in the queue, so that the emulator makes up for
+    // them, unless it has fallen too far behind
+    const auto lag = static_cast<int32_t>(played - queued);
+    if (lag > static_cast<int32_t>(AUDIO_SYNC_MAX_LAG_FRAMES)) {
+        queued = played;
+    } else if (lag <= -static_cast<int32_t>(AUDIO_SYNC_QUEUE_SIZE)) {
+        overruns_++;
+        return;
+    }
+
+    queuedFrames_[queued % AUDIO_SYNC_QUEUE_SIZE] = active;
+    framesQueued_.store(queued + 1, std::memory_order_release);
+}
+
+void Audio::waitForFrame() {
+    const auto frameMs = static_cast<Uint32>(std::ceil(1000.0 / TIMER_FREQUENCY));
+
+    while (static_cast<int32_t>(framesQueued_.load(std::memory_order_relaxed) -
+                                framesPlayed_.load(std::memory_order_acquire)) >=
+           static_cast<int32_t>(AUDIO_SYNC_LEAD_FRAMES)) {
+        if (SDL_SemWaitTimeout(framePlayed_, frameMs) == SDL_MUTEX_TIMEDOUT) {
+            return;
         }
-    };
+    }
+}
 
-    std::thread(playFunc).detach();
+Audio::SyncStats Audio::takeSyncStats() {
+    SyncStats stats{framesSinceStats_, underruns_.exchange(0, std::memory_order_relaxed), overruns_};
+    framesSinceStats_ = 0;
+    overruns_ = 0;
+    return stats;
+}
+
+void Audio::setPattern(const AudioPattern &pattern) {
+    // Only this thread changes the pattern, so it can be compared without locking
+    if (pattern != pattern_) {
+        SDL_LockAudioDevice(audioDevice_);
+        pattern_ = pattern;
+        SDL_UnlockAudioDevice(audioDevice_);
+    }
 }
 
 void Audio::audioCallback(void *data, Uint8 *buffer, int length) {
     auto *audio = reinterpret_cast<Audio *>(data);
 
-    // Generate a simple sound wave
+    if (audio->sync_) {
+        audio->generateQueued(buffer, length);
+    } else {
+        audio->generate(buffer, length, audio->active_.load(std::memory_order_relaxed));
+    }
+}
+
+void Audio::generateQueued(Uint8 *buffer, int length) {
+    while (length > 0) {
+        if (frameSamplesLeft_ == 0) {
+            const auto frame = framesPlayed_.load(std::memory_order_relaxed);
+
+            if (static_cast<int32_t>(framesQueued_.load(std::memory_order_acquire) - frame) > 0) {
+                frameActive_ = queuedFrames_[frame % AUDIO_SYNC_QUEUE_SIZE];
+            } else {
+                frameActive_ = false;
+                underruns_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // A second of frames takes exactly a second of samples, spread as evenly as whole samples allow
+            const auto second = frame % TIMER_FREQUENCY;
+            frameSamplesLeft_ = (second + 1) * AUDIO_SAMPLE_FREQUENCY / TIMER_FREQUENCY -
+                                second * AUDIO_SAMPLE_FREQUENCY / TIMER_FREQUENCY;
+
+            framesPlayed_.store(frame + 1, std::memory_order_release);
+            SDL_SemPost(framePlayed_);
+        }
+
+        const auto samples = std::min(frameSamplesLeft_, static_cast<unsigned int>(length));
+        generate(buffer, static_cast<int>(samples), frameActive_);
+        buffer += samples;
+        length -= static_cast<int>(samples);
+        frameSamplesLeft_ -= samples;
+    }
+}
+
+void Audio::generate(Uint8 *buffer, int length, bool active) {
+    // Every sound starts from the beginning of its wave
+    if (!active) {
+        std::fill(buffer, buffer + length, 128);
+        tonePos_ = 0;
+        patternPos_ = 0;
+        return;
+    }
+
+    if (pattern_.loaded) {
+        // Each bit of the pattern is a sample, played at its own rate and looped
+        const auto step = pattern_.sampleRate() / AUDIO_SAMPLE_FREQUENCY;
+        const auto patternBits = AUDIO_PATTERN_SIZE * 8;
+
+        for (int i = 0; i < length; i++) {
+            const auto bit = static_cast<unsigned int>(patternPos_);
+            const auto sample = pattern_.samples[bit / 8] >> (7 - bit % 8) & 1;
+            buffer[i] = sample ? 191 : 64;
+
+            patternPos_ += step;
+            if (patternPos_ >= patternBits) {
+                patternPos_ -= patternBits;
+            }
+        }
+        return;
+    }
+
     for (int i = 0; i < length; i++) {
-        buffer[i] = (std::sin(audio->samplePos_ / audio->samplesPerSine_ * M_PI * 2) + 1) * 127.5;
-        ++audio->samplePos_;
+        buffer[i] = tone_[tonePos_];
+        if (++tonePos_ == AUDIO_TONE_SAMPLES) {
+            tonePos_ = 0;
+        }
     }
 }
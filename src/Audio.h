@@ -1,23 +1,88 @@
 #pragma once
 
+#include "AudioPattern.h"
+
 #include <SDL2/SDL.h>
 
+#include <array>
+#include <atomic>
+
+const int AUDIO_SAMPLE_FREQUENCY = 32000;
+const int AUDIO_TONE_FREQUENCY = 500;
+
+// The beep is played from one precomputed cycle of its wave
+const unsigned int AUDIO_TONE_SAMPLES = AUDIO_SAMPLE_FREQUENCY / AUDIO_TONE_FREQUENCY;
+static_assert(AUDIO_SAMPLE_FREQUENCY % AUDIO_TONE_FREQUENCY == 0);
+
+// When synced to the audio clock, the sound of this many frames is queued ahead of the frame being played. The audio
+// callback asks for about a frame of samples at a time, so it always finds the frames it plays already queued.
+const unsigned int AUDIO_SYNC_LEAD_FRAMES = 3;
+const unsigned int AUDIO_SYNC_QUEUE_SIZE = 16;
+
+// After falling further behind the audio clock than this, the missed frames are skipped instead of rushed through
+const unsigned int AUDIO_SYNC_MAX_LAG_FRAMES = 6;
+
 class Audio {
 public:
-    explicit Audio(bool mute);
+    // Frames queued and missed since the last call to takeSyncStats
+    struct SyncStats {
+        unsigned int frames;
+        unsigned int underruns; // Frames which were due to play before the emulator had queued them
+        unsigned int overruns; // Frames which didn't fit in the queue, because the device stopped playing
+    };
+
+    // With sync, the audio device is the clock which paces emulation, through queueFrame and waitForFrame
+    Audio(bool mute, bool sync);
 
     ~Audio();
 
-    void play() const;
+    // Sounds the buzzer while active, with the XO-CHIP audio pattern if one has been loaded or a beep otherwise. Called
+    // every frame with the state of the sound timer, so the sound lasts exactly as long as the timer runs.
+    void update(bool active, const AudioPattern &pattern);
+
+    // Queues the sound of the next frame when synced to the audio clock. It plays once the frames before it have.
+    void queueFrame(bool active, const AudioPattern &pattern);
+
+    // Sleeps until the device has played far enough into the queue that another frame is due. Gives up after a frame
+    // without anything being played, so that emulation carries on if the device stops.
+    void waitForFrame();
+
+    SyncStats takeSyncStats();
 
 private:
     static void audioCallback(void *data, Uint8 *buffer, int length);
 
+    void setPattern(const AudioPattern &pattern);
+
+    // Plays the tone or pattern, or silence if the buzzer is off
+    void generate(Uint8 *buffer, int length, bool active);
+
+    // Plays the queued frames, taking the next one off the queue whenever a frame's worth of samples has been played
+    void generateQueued(Uint8 *buffer, int length);
+
     SDL_AudioDeviceID audioDevice_;
 
     bool mute_;
-    const double sineFreq_;
-    const int sampleFreq_;
-    const double samplesPerSine_;
-    uint32_t samplePos_;
+    const bool sync_;
+    std::atomic<bool> active_; // Read by the audio callback, which plays silence while it's cleared
+
+    std::array<uint8_t, AUDIO_TONE_SAMPLES> tone_;
+    unsigned int tonePos_;
+
+    AudioPattern pattern_; // Shared with the audio callback, so only changed while the device is locked
+    double patternPos_; // Position in the pattern in samples of the pattern
+
+    // Whether the buzzer is on in each queued frame. Frames are counted from the start, and only the audio callback
+    // advances framesPlayed_ and only the emulator advances framesQueued_, so neither needs a lock.
+    std::array<bool, AUDIO_SYNC_QUEUE_SIZE> queuedFrames_;
+    std::atomic<uint32_t> framesQueued_;
+    std::atomic<uint32_t> framesPlayed_;
+    bool frameActive_; // Whether the buzzer is on in the frame being played
+    unsigned int frameSamplesLeft_;
+
+    SDL_sem *framePlayed_; // Posted by the audio callback whenever it starts playing a frame
+
+    std::atomic<unsigned int> underruns_;
+    unsigned int overruns_;
+    unsigned int framesSinceStats_;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+const unsigned int AUDIO_PATTERN_SIZE = 16;
+const uint8_t DEFAULT_AUDIO_PITCH = 64;
+
+// XO-CHIP sound: 128 one bit samples loaded by F002, looped at a rate set by the pitch register with FX3A. Until a
+// pattern is loaded, the usual beep is played instead.
+struct AudioPattern {
+    std::array<uint8_t, AUDIO_PATTERN_SIZE> samples;
+    uint8_t pitch;
+    bool loaded;
+
+    // Samples per second. A pitch of 64 plays 4000 samples per second, and every 48 above or below it is an octave.
+    [[nodiscard]] double sampleRate() const {
+        return 4000 * std::pow(2.0, (pitch - 64) / 48.0);
+    }
+
+    bool operator==(const AudioPattern &other) const {
+        return samples == other.samples && pitch == other.pitch && loaded == other.loaded;
+    }
+
+    bool operator!=(const AudioPattern &other) const {
+        return !(*this == other);
+    }
+};
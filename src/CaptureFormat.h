@@ -0,0 +1,6 @@
+#pragma once
+
+enum class CaptureFormat {
+    Y4M, // YUV4MPEG2 stream of 4:4:4 frames, which encoders such as ffmpeg read directly
+    PPM // Binary PPM images one after another, as read by ffmpeg's image2pipe
+};
@@ -1,5 +1,9 @@
 #include "Chip8.h"
+#include "Execute.h"
+#include "SaveState.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <cstddef>
 #include <cstring>
@@ -8,9 +12,13 @@
 #include <limits>
 
 const unsigned int SPRITE_WIDTH = 8;
-const unsigned int ROM_START_ADDRESS = 0x200;
-const unsigned int FONT_SET_START_ADDRESS = 0x050;
-const unsigned int CHARACTER_SPRITE_WIDTH = 0x5;
+const unsigned int MAX_BLOCK_LENGTH = 32;
+
+// Most bytes a block can cover: the last instruction added to a block can be a superinstruction of 3 opcodes
+const unsigned int MAX_BLOCK_BYTES = (MAX_BLOCK_LENGTH + 2) * 2;
+
+// Dropped blocks leave their instructions behind in the buffer, so it's emptied once it has grown this big
+const std::size_t MAX_BLOCK_INSTRUCTIONS = MEMORY_SIZE;
 
 const std::array<uint8_t, FONT_SET_SIZE> FONT_SET{
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -31,27 +39,58 @@ const std::array<uint8_t, FONT_SET_SIZE> FONT_SET{
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-// Timers should run at 60 hertz
-// See: https://github.com/AfBu/haxe-CHIP-8-emulator/wiki/(Super)CHIP-8-Secrets#speed-of-emulation
-const double TIMER_DELAY = (1.0 / 60.0) * 1000000000;
+// 8x10 characters used by FX30 on the SCHIP
+const std::array<uint8_t, BIG_FONT_SET_SIZE> BIG_FONT_SET{
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
 
-Chip8::Chip8(Mode mode) : mode_{mode},
-                          randEngine_(chrono::system_clock::now().time_since_epoch().count()),
-                          randByte_{std::uniform_int_distribution<uint8_t>(std::numeric_limits<uint8_t>::min(),
-                                                                           std::numeric_limits<uint8_t>::max())},
-                          timer_{TIMER_DELAY} {
+Chip8::Chip8(Mode mode, Quirks quirks, Engine engine, unsigned int cyclesPerTimerTick)
+        : rplFlags_{},
+          mode_{mode},
+          quirks_{modeQuirks(mode) | quirks},
+          engine_{engine},
+          engineFunctions_{selectEngine(engine, quirks_, std::make_index_sequence<RUNTIME_QUIRKS>{})},
+          decodeTable_{decodeTable()},
+          instructionCache_(MEMORY_SIZE),
+          blocks_(MEMORY_SIZE),
+          jit_{engine == Engine::JIT ? std::make_unique<Jit>(quirks_, MEMORY_SIZE) : nullptr},
+          aotProgram_{nullptr},
+          aotStaleCode_{0},
+          randEngine_(std::chrono::system_clock::now().time_since_epoch().count()),
+          randByte_{std::uniform_int_distribution<uint8_t>(std::numeric_limits<uint8_t>::min(),
+                                                           std::numeric_limits<uint8_t>::max())},
+          cyclesPerTimerTick_{cyclesPerTimerTick},
+          cyclesUntilTimerTick_{cyclesPerTimerTick} {
     reset();
 
-    for (unsigned int i = 0; i < FONT_SET_SIZE; i++) {
-        memory_[i + FONT_SET_START_ADDRESS] = FONT_SET[i];
-    }
+    // Fill all tables first, so that opcodes without an entry don't call through a null pointer
+    std::fill(std::begin(funcTable0_), std::end(funcTable0_), &Chip8::opcodeUnknown);
+    std::fill(std::begin(funcTable5_), std::end(funcTable5_), &Chip8::opcode5XY0);
+    std::fill(std::begin(funcTable8_), std::end(funcTable8_), &Chip8::opcodeUnknown);
+    std::fill(std::begin(funcTableE_), std::end(funcTableE_), &Chip8::opcodeUnknown);
+    std::fill(std::begin(funcTableF_), std::end(funcTableF_), &Chip8::opcodeUnknown);
 
     funcTable_[0x0] = &Chip8::decodeFuncTable0;
     funcTable_[0x1] = &Chip8::opcode1NNN;
     funcTable_[0x2] = &Chip8::opcode2NNN;
     funcTable_[0x3] = &Chip8::opcode3XNN;
     funcTable_[0x4] = &Chip8::opcode4XNN;
-    funcTable_[0x5] = &Chip8::opcode5XY0;
+    funcTable_[0x5] = &Chip8::decodeFuncTable5;
     funcTable_[0x6] = &Chip8::opcode6XNN;
     funcTable_[0x7] = &Chip8::opcode7XNN;
     funcTable_[0x8] = &Chip8::decodeFuncTable8;
@@ -63,8 +102,24 @@ Chip8::Chip8(Mode mode) : mode_{mode},
     funcTable_[0xE] = &Chip8::decodeFuncTableE;
     funcTable_[0xF] = &Chip8::decodeFuncTableF;
 
-    funcTable0_[0x0] = &Chip8::opcode00E0;
-    funcTable0_[0xE] = &Chip8::opcode00EE;
+    // 00E0 and 00EE are matched on the low nibble alone, except where the SCHIP opcodes below take over
+    for (unsigned int high = 0; high <= 0xF0; high += 0x10) {
+        funcTable0_[high | 0x0] = &Chip8::opcode00E0;
+        funcTable0_[high | 0xE] = &Chip8::opcode00EE;
+    }
+    for (unsigned int n = 0; n <= 0xF; n++) {
+        funcTable0_[0xC0 | n] = &Chip8::opcode00CN;
+        funcTable0_[0xD0 | n] = &Chip8::opcode00DN;
+    }
+    funcTable0_[0xFB] = &Chip8::opcode00FB;
+    funcTable0_[0xFC] = &Chip8::opcode00FC;
+    funcTable0_[0xFD] = &Chip8::opcode00FD;
+    funcTable0_[0xFE] = &Chip8::opcode00FE;
+    funcTable0_[0xFF] = &Chip8::opcode00FF;
+
+    // 5XY0 is matched on the high nibble alone, apart from the XO-CHIP opcodes
+    funcTable5_[0x2] = &Chip8::opcode5XY2;
+    funcTable5_[0x3] = &Chip8::opcode5XY3;
 
     funcTable8_[0x0] = &Chip8::opcode8XY0;
     funcTable8_[0x1] = &Chip8::opcode8XY1;
@@ -79,15 +134,22 @@ Chip8::Chip8(Mode mode) : mode_{mode},
     funcTableE_[0x1] = &Chip8::opcodeEXA1;
     funcTableE_[0xE] = &Chip8::opcodeEX9E;
 
+    funcTableF_[0x00] = &Chip8::opcodeF000;
+    funcTableF_[0x01] = &Chip8::opcodeFN01;
+    funcTableF_[0x02] = &Chip8::opcodeF002;
     funcTableF_[0x07] = &Chip8::opcodeFX07;
     funcTableF_[0x0A] = &Chip8::opcodeFX0A;
     funcTableF_[0x15] = &Chip8::opcodeFX15;
     funcTableF_[0x18] = &Chip8::opcodeFX18;
     funcTableF_[0x1E] = &Chip8::opcodeFX1E;
     funcTableF_[0x29] = &Chip8::opcodeFX29;
+    funcTableF_[0x30] = &Chip8::opcodeFX30;
     funcTableF_[0x33] = &Chip8::opcodeFX33;
+    funcTableF_[0x3A] = &Chip8::opcodeFX3A;
     funcTableF_[0x55] = &Chip8::opcodeFX55;
     funcTableF_[0x65] = &Chip8::opcodeFX65;
+    funcTableF_[0x75] = &Chip8::opcodeFX75;
+    funcTableF_[0x85] = &Chip8::opcodeFX85;
 }
 
 void Chip8::reset() {
@@ -98,42 +160,449 @@ void Chip8::reset() {
     delayTimer_ = 0;
     soundTimer_ = 0;
     drawFlag_ = true;
-    soundFlag_ = false;
+    cyclesUntilTimerTick_ = cyclesPerTimerTick_;
     stack_.fill(0);
     registers_.fill(0);
-    keys_.fill(0);
-
-    std::fill(std::begin(memory_), std::begin(memory_) + FONT_SET_START_ADDRESS, 0);
-    std::fill(std::begin(memory_) + FONT_SET_START_ADDRESS + FONT_SET_SIZE, std::end(memory_), 0);
+    keys_ = 0;
+
+    memory_.fill(0);
+    std::copy(FONT_SET.begin(), FONT_SET.end(), memory_.begin() + FONT_SET_START_ADDRESS);
+    std::copy(BIG_FONT_SET.begin(), BIG_FONT_SET.end(), memory_.begin() + BIG_FONT_SET_START_ADDRESS);
+    std::fill(instructionCache_.begin(), instructionCache_.end(), Instruction{});
+    flushBlocks();
+    aotProgram_ = nullptr;
+    aotStale_.reset();
+    aotStaleCode_ = 0;
+
+    selectedPlanes_ = 1;
+    audioPattern_ = {{}, DEFAULT_AUDIO_PITCH, false};
+    setHighResolution(false);
+}
 
-    clearScreen();
+void Chip8::seed(unsigned int seed) {
+    randEngine_.seed(seed);
 }
 
 void Chip8::cycle() {
+    ((*this).*(engineFunctions_.cycle))();
+    countCycles(1);
+}
+
+void Chip8::run(unsigned int cycles) {
+    ((*this).*(engineFunctions_.run))(cycles);
+}
+
+// Returns the functions of the given engine, specialised for the given quirks. The engines other than the table engine
+// step through single instructions with the switch engine.
+template <Quirks Q>
+Chip8::EngineFunctions Chip8::engineFunctions(Engine engine) {
+    switch (engine) {
+        case Engine::TABLE:
+            return {&Chip8::cycleTable, &Chip8::runTable};
+        case Engine::BLOCK:
+            return {&Chip8::cycleSwitch<Q>, &Chip8::runBlocks<Q>};
+        case Engine::JIT:
+            return {&Chip8::cycleSwitch<Q>, &Chip8::runJit<Q>};
+        case Engine::AOT:
+            return {&Chip8::cycleSwitch<Q>, &Chip8::runAot<Q>};
+        default:
+            return {&Chip8::cycleSwitch<Q>, &Chip8::runSwitch<Q>};
+    }
+}
+
+// Instantiates the engines for every combination of quirks, and picks the one for the given quirks
+template <std::size_t... Q>
+Chip8::EngineFunctions Chip8::selectEngine(Engine engine, Quirks quirks, std::index_sequence<Q...>) {
+    static constexpr EngineFunctions (*INSTANTIATIONS[])(Engine){&Chip8::engineFunctions<Q>...};
+
+    if (quirks >= sizeof...(Q)) {
+        throw std::runtime_error("Unknown quirks: " + std::to_string(quirks));
+    }
+    return INSTANTIATIONS[quirks](engine);
+}
+
+void Chip8::runTable(unsigned int cycles) {
+    for (unsigned int i = 0; i < cycles; i++) {
+        cycleTable();
+        countCycles(1);
+    }
+}
+
+template <Quirks Q>
+void Chip8::runSwitch(unsigned int cycles) {
+    for (unsigned int i = 0; i < cycles; i++) {
+        cycleSwitch<Q>();
+        countCycles(1);
+    }
+}
+
+// Update timers based on the number of executed instructions rather than the wall clock, so that timer behaviour
+// doesn't depend on the speed of the host. Callers never pass in more cycles than are left until the next tick.
+void Chip8::countCycles(unsigned int cycles) {
+    if (cyclesPerTimerTick_ != 0) {
+        cyclesUntilTimerTick_ -= cycles;
+
+        if (cyclesUntilTimerTick_ == 0) {
+            cyclesUntilTimerTick_ = cyclesPerTimerTick_;
+            tick();
+        }
+    }
+}
+
+unsigned int Chip8::idleCycles(unsigned int maxCycles) const {
+    const auto loopLength = idleLoopLength();
+    if (loopLength == 0) {
+        return 0;
+    }
+
+    // The timer tick may end the loop, so it's only skipped up to the tick
+    if (cyclesPerTimerTick_ != 0) {
+        maxCycles = std::min(maxCycles, cyclesUntilTimerTick_);
+    }
+    return maxCycles - maxCycles % loopLength;
+}
+
+void Chip8::skipIdleCycles(unsigned int cycles) {
+    countCycles(cycles);
+}
+
+// Returns the number of instructions in the loop the machine is stuck in, or 0 if it isn't stuck. The loop is found by
+// following the instructions from pc on a copy of the registers. Only instructions which don't change anything but the
+// registers and pc are followed, and the loop only counts if the registers are the same once pc comes back around, as
+// every further iteration then does exactly the same. Nothing those instructions read changes until a timer tick or a
+// key press.
+unsigned int Chip8::idleLoopLength() const {
+    const unsigned int maxLoopLength = 8;
+
+    auto registers = registers_;
+    unsigned int pc = pc_;
+    const unsigned int keys = keys_.load(std::memory_order_relaxed);
+
+    for (unsigned int length = 1; length <= maxLoopLength; length++) {
+        const unsigned int opcode = memory_[pc & (MEMORY_SIZE - 1)] << 8 | memory_[(pc + 1) & (MEMORY_SIZE - 1)];
+        const unsigned int x = (opcode & 0x0F00) >> 8;
+        const unsigned int y = (opcode & 0x00F0) >> 4;
+        const auto nn = static_cast<uint8_t>(opcode & 0x00FF);
+
+        // Skips jump over F000 NNNN as a whole, like skipLength
+        const unsigned int skip = memory_[(pc + 2) & (MEMORY_SIZE - 1)] == 0xF0 &&
+                                  memory_[(pc + 3) & (MEMORY_SIZE - 1)] == 0x00 ? 6 : 4;
+
+        if (opcode == 0x00FD) {
+            // Halted
+        } else if ((opcode & 0xF000) == 0x1000) {
+            pc = opcode & 0x0FFF;
+        } else if ((opcode & 0xF000) == 0x3000) {
+            pc += registers[x] == nn ? skip : 2;
+        } else if ((opcode & 0xF000) == 0x4000) {
+            pc += registers[x] != nn ? skip : 2;
+        } else if ((opcode & 0xF00F) == 0x5000) {
+            pc += registers[x] == registers[y] ? skip : 2;
+        } else if ((opcode & 0xF000) == 0x6000) {
+            registers[x] = nn;
+            pc += 2;
+        } else if ((opcode & 0xF00F) == 0x9000) {
+            pc += registers[x] != registers[y] ? skip : 2;
+        } else if ((opcode & 0xF0FF) == 0xE09E) {
+            pc += (keys >> (registers[x] & 0xF) & 1) != 0 ? skip : 2;
+        } else if ((opcode & 0xF0FF) == 0xE0A1) {
+            pc += (keys >> (registers[x] & 0xF) & 1) == 0 ? skip : 2;
+        } else if ((opcode & 0xF0FF) == 0xF007) {
+            registers[x] = delayTimer_;
+            pc += 2;
+        } else if ((opcode & 0xF0FF) == 0xF00A && keys == 0) {
+            // Waiting for a key
+        } else {
+            return 0;
+        }
+
+        if ((pc & 0xFFFF) == pc_) {
+            return registers == registers_ ? length : 0;
+        }
+    }
+
+    return 0;
+}
+
+// Timers should run at 60 hertz
+// See: https://github.com/AfBu/haxe-CHIP-8-emulator/wiki/(Super)CHIP-8-Secrets#speed-of-emulation
+void Chip8::tick() {
+    if (delayTimer_ > 0) {
+        delayTimer_--;
+    }
+
+    if (soundTimer_ > 0) {
+        soundTimer_--;
+    }
+}
+
+void Chip8::cycleTable() {
     // Fetch Opcode - each address is one byte, so shift it by 8 bits and merge with next opcode to get full one.
-    opcode_ = memory_[pc_] << 8 | memory_[pc_ + 1];
+    opcode_ = memory_[pc_] << 8 | memory_[(pc_ + 1) & (MEMORY_SIZE - 1)];
 
     // Decode and execute opcode
     ((*this).*(funcTable_[(opcode_ & 0xF000) >> 12]))();
+}
+
+template <Quirks Q>
+[[gnu::always_inline]] inline void Chip8::cycleSwitch() {
+    // The address is masked so that a runaway pc can't index past the end of the cache
+    const auto address = pc_ & (MEMORY_SIZE - 1);
+    auto &instruction = instructionCache_[address];
+
+    if (instruction.op == Op::UNDECODED) {
+        // The fetched opcode indexes straight into the decode table, so there's no decoding left to do here
+        instruction = decodeTable_[memory_[address] << 8 | memory_[(address + 1) & (MEMORY_SIZE - 1)]];
+    }
+
+    execute<Q>(instruction);
+}
+
+template <Quirks Q>
+void Chip8::runBlocks(unsigned int cycles) {
+    while (cycles > 0) {
+        // A block is only executed if it can't run past the requested number of cycles or the next timer tick, so
+        // that the timers are ticked after exactly the same instruction as with the other engines
+        auto limit = cycles;
+        if (cyclesPerTimerTick_ != 0) {
+            limit = std::min(limit, cyclesUntilTimerTick_);
+        }
+
+        unsigned int executed = 0;
+
+        // Neither buffer is reallocated by executing instructions, only by building blocks
+        auto *const blocks = blocks_.data();
+        const auto *instructions = blockInstructions_.data();
+
+        while (executed < limit) {
+            const auto address = pc_ & (MEMORY_SIZE - 1);
+            if (blocks[address].length == 0) {
+                // Nothing is running from the buffer in between blocks, so it can be emptied here
+                if (blockInstructions_.size() > MAX_BLOCK_INSTRUCTIONS) {
+                    flushBlocks();
+                }
+                blocks[address] = buildBlock(address);
+                instructions = blockInstructions_.data();
+            }
+            const auto current = blocks[address];
+            const auto *first = &instructions[current.first];
+            const auto *last = first + current.size;
+
+            if (current.length <= limit - executed) {
+                // Loops that jump back to their own start, such as timer polling loops, are repeated here without
+                // looking the block up again, unless the block has just overwritten itself
+                do {
+                    for (const auto *instruction = first; instruction != last; instruction++) {
+                        executed += execute<Q>(*instruction);
+                    }
+                } while (pc_ == address && current.length <= limit - executed && blocks[address].length != 0);
+            } else if (opcodeCount(*first) <= limit - executed) {
+                // Blocks are often longer than the instructions left until the next timer tick, so as much of the block
+                // as fits is run. Only the last instruction of a block can branch or write to memory, so the others
+                // always run straight through.
+                for (const auto *instruction = first;
+                     instruction != last && opcodeCount(*instruction) <= limit - executed; instruction++) {
+                    executed += execute<Q>(*instruction);
+                }
+            } else {
+                cycleSwitch<Q>();
+                executed++;
+            }
+        }
+
+        cycles -= executed;
+        countCycles(executed);
+    }
+}
+
+// Translates the instructions from the given address up to the next branch into a block, fusing common sequences
+// into superinstructions. Skips, jumps, calls, returns, FX0A and memory writes all end a block: the next instruction
+// after them either isn't known until they're executed, or may have just been overwritten.
+Block Chip8::buildBlock(unsigned int address) {
+    Block newBlock{static_cast<uint32_t>(blockInstructions_.size()), 0, 0};
+    const auto start = address;
+
+    auto fetch = [this](unsigned int opcodeAddress) {
+        if (opcodeAddress + 1 >= MEMORY_SIZE) {
+            return Instruction{Op::UNKNOWN, 0, 0, 0, 0, 0};
+        }
+        return decodeTable_[memory_[opcodeAddress] << 8 | memory_[opcodeAddress + 1]];
+    };
+
+    while (newBlock.length < MAX_BLOCK_LENGTH) {
+        auto instruction = fetch(address);
+        const auto next = fetch(address + 2);
+        bool endOfBlock = false;
+        unsigned int opcodes = 1;
+
+        switch (instruction.op) {
+            case Op::OPCODE_FX07: {
+                // FX07, 3X00, 1NNN: wait until the delay timer reaches 0
+                const auto afterNext = fetch(address + 4);
+                if (next.op == Op::OPCODE_3XNN && next.x == instruction.x && afterNext.op == Op::OPCODE_1NNN) {
+                    instruction = {Op::FUSED_FX07_3XNN_1NNN, next.x, 0, 0, next.nn, afterNext.nnn};
+                    opcodes = 3;
+                    endOfBlock = true;
+                }
+                break;
+            }
+            case Op::OPCODE_3XNN:
+            case Op::OPCODE_4XNN:
+                if (next.op == Op::OPCODE_1NNN) {
+                    instruction.op = instruction.op == Op::OPCODE_3XNN ? Op::FUSED_3XNN_1NNN : Op::FUSED_4XNN_1NNN;
+                    instruction.nnn = next.nnn;
+                    opcodes = 2;
+                }
+                endOfBlock = true;
+                break;
+            case Op::OPCODE_EX9E:
+            case Op::OPCODE_EXA1:
+                if (next.op == Op::OPCODE_1NNN) {
+                    instruction.op = instruction.op == Op::OPCODE_EX9E ? Op::FUSED_EX9E_1NNN : Op::FUSED_EXA1_1NNN;
+                    instruction.nnn = next.nnn;
+                    opcodes = 2;
+                }
+                endOfBlock = true;
+                break;
+            case Op::OPCODE_ANNN:
+                if (next.op == Op::OPCODE_DXYN) {
+                    instruction = {Op::FUSED_ANNN_DXYN, next.x, next.y, next.n, 0, instruction.nnn};
+                    opcodes = 2;
+                }
+                break;
+            case Op::OPCODE_00EE:
+            case Op::OPCODE_00FD:
+            case Op::OPCODE_1NNN:
+            case Op::OPCODE_2NNN:
+            case Op::OPCODE_5XY0:
+            case Op::OPCODE_9XY0:
+            case Op::OPCODE_BNNN:
+            case Op::OPCODE_5XY2:
+            case Op::OPCODE_F000:
+            case Op::OPCODE_FX0A:
+            case Op::OPCODE_FX33:
+            case Op::OPCODE_FX55:
+            case Op::UNKNOWN:
+                endOfBlock = true;
+                break;
+            default:
+                break;
+        }
+
+        blockInstructions_.push_back(instruction);
+        newBlock.size++;
+        newBlock.length += opcodes;
+        address += opcodes * 2;
+
+        if (endOfBlock) {
+            break;
+        }
+    }
+
+    for (unsigned int i = start; i < address && i < MEMORY_SIZE; i++) {
+        blockCode_.set(i);
+    }
+
+    return newBlock;
+}
 
-    // Update timers
-    if (timer_.intervalElapsed()) {
-        if (delayTimer_ > 0) {
-            delayTimer_--;
+// Mirrors runBlocks, but executes blocks compiled by the JIT. Compiled blocks stop once they've run the opcodes left
+// before the timer tick, and never write to memory, so they can't be invalidated while running. Instructions which the
+// JIT can't translate, and blocks which aren't hot yet, are executed by the switch engine.
+template <Quirks Q>
+void Chip8::runJit(unsigned int cycles) {
+    while (cycles > 0) {
+        auto limit = cycles;
+        if (cyclesPerTimerTick_ != 0) {
+            limit = std::min(limit, cyclesUntilTimerTick_);
         }
 
-        if (soundTimer_ > 0) {
-            if (soundTimer_ == 1) {
-                soundFlag_ = true;
+        unsigned int executed = 0;
+
+        while (executed < limit) {
+            const auto address = pc_ & (MEMORY_SIZE - 1);
+            const auto &current = jit_->block(memory_.data(), address);
+
+            if (current.length != 0) {
+                do {
+                    const auto result = current.function(registers_.data(), &index_, limit - executed,
+                                                         keys_.load(std::memory_order_relaxed));
+                    pc_ = result & 0xFFFF;
+                    executed += result >> 16;
+                } while (pc_ == address && executed < limit);
+            } else {
+                // Instructions which wait in place, such as FX0A, are repeated without looking the block up again
+                do {
+                    cycleSwitch<Q>();
+                    executed++;
+                } while (pc_ == address && executed < limit);
             }
-            soundTimer_--;
         }
+
+        cycles -= executed;
+        countCycles(executed);
     }
 }
 
+// Runs the translated program until it reaches code it can't run, then executes a single instruction with the switch
+// engine and tries again
+template <Quirks Q>
+void Chip8::runAot(unsigned int cycles) {
+    while (cycles > 0) {
+        auto limit = cycles;
+        if (cyclesPerTimerTick_ != 0) {
+            limit = std::min(limit, cyclesUntilTimerTick_);
+        }
+
+        unsigned int executed = 0;
+
+        while (executed < limit) {
+            if (aotProgram_) {
+                executed += aotProgram_->run(*this, limit - executed);
+            }
+
+            if (executed < limit) {
+                cycleSwitch<Q>();
+                executed++;
+            }
+        }
+
+        cycles -= executed;
+        countCycles(executed);
+    }
+}
+
+// Drops the blocks which cover a written address. Their instructions stay in the buffer, so a block which overwrote
+// itself still finishes, and is only built again the next time it's run. Other blocks are kept.
+void Chip8::invalidateBlocks(unsigned int address) {
+    const auto firstStart = address >= MAX_BLOCK_BYTES ? address - MAX_BLOCK_BYTES + 1 : 0;
+    for (auto start = firstStart; start <= address; start++) {
+        if (blocks_[start].length != 0 && start + 2u * blocks_[start].length > address) {
+            blocks_[start] = Block{};
+        }
+    }
+
+    // No block covers the address any more. The other bytes of the dropped blocks stay marked until they're written.
+    blockCode_.reset(address);
+}
+
+void Chip8::flushBlocks() {
+    if (jit_) {
+        jit_->flush();
+    }
+    std::fill(blocks_.begin(), blocks_.end(), Block{});
+    blockInstructions_.clear();
+    blockCode_.reset();
+}
+
 void Chip8::decodeFuncTable0() {
-    // Only the lower 4 bits of the low byte are different in 0x0 opcodes
-    ((*this).*(funcTable0_[(opcode_ & 0x000F)]))();
+    // Only the low byte is different in 0x0 opcodes
+    ((*this).*(funcTable0_[(opcode_ & 0x00FF)]))();
+}
+
+void Chip8::decodeFuncTable5() {
+    // Only the lower 4 bits of the low byte are different in 0x5 opcodes
+    ((*this).*(funcTable5_[(opcode_ & 0x000F)]))();
 }
 
 void Chip8::decodeFuncTable8() {
@@ -152,7 +621,7 @@ void Chip8::decodeFuncTableF() {
 }
 
 void Chip8::opcodeUnknown() {
-    std::cerr << &"Unknown opcode: 0x"[opcode_] << std::endl;
+    std::cerr << "Unknown opcode: 0x" << std::hex << opcode_ << std::dec << std::endl;
 }
 
 // 0x00E0: Clears the screen
@@ -165,11 +634,58 @@ void Chip8::opcode00E0() {
 // 0x00EE: Returns from subroutine
 void Chip8::opcode00EE() {
     // Restore pc from stack
-    sp_--;
+    // The stack pointer wraps around, so that unbalanced calls and returns can't index outside of the stack
+    sp_ = (sp_ - 1) & (STACK_SIZE - 1);
     pc_ = stack_[sp_];
     pc_ += 2;
 }
 
+// 00CN: Scrolls the screen down by N rows (SCHIP)
+void Chip8::opcode00CN() {
+    scrollDown(opcode_ & 0x000F);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
+// 00DN: Scrolls the screen up by N rows (XO-CHIP)
+void Chip8::opcode00DN() {
+    scrollUp(opcode_ & 0x000F);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
+// 00FB: Scrolls the screen right by 4 pixels (SCHIP)
+void Chip8::opcode00FB() {
+    scrollRight(4);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
+// 00FC: Scrolls the screen left by 4 pixels (SCHIP)
+void Chip8::opcode00FC() {
+    scrollLeft(4);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
+// 00FD: Exits the interpreter (SCHIP). The pc isn't incremented, so the machine stays on this instruction.
+void Chip8::opcode00FD() {
+}
+
+// 00FE: Switches to the 64x32 low resolution mode (SCHIP)
+void Chip8::opcode00FE() {
+    setHighResolution(false);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
+// 00FF: Switches to the 128x64 high resolution mode (SCHIP)
+void Chip8::opcode00FF() {
+    setHighResolution(true);
+    drawFlag_ = true;
+    pc_ += 2;
+}
+
 // 1NNN: Jumps to address NNN
 void Chip8::opcode1NNN() {
     auto address = opcode_ & 0x0FFF;
@@ -181,7 +697,7 @@ void Chip8::opcode1NNN() {
 void Chip8::opcode2NNN() {
     // Put current pc onto stack
     stack_[sp_] = pc_;
-    sp_++;
+    sp_ = (sp_ + 1) & (STACK_SIZE - 1);
 
     auto address = opcode_ & 0x0FFF;
     pc_ = address;
@@ -193,7 +709,7 @@ void Chip8::opcode3XNN() {
     auto nn = opcode_ & 0x00FF;
 
     if (registers_[x] == nn) {
-        pc_ += 4;
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
@@ -205,7 +721,7 @@ void Chip8::opcode4XNN() {
     auto nn = opcode_ & 0x00FF;
 
     if (registers_[x] != nn) {
-        pc_ += 4;
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
@@ -217,12 +733,39 @@ void Chip8::opcode5XY0() {
     auto y = (opcode_ & 0x00F0) >> 4;
 
     if (registers_[x] == registers_[y]) {
-        pc_ += 4;
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
 }
 
+// 5XY2: Stores VX to VY in memory starting at address I, in descending order if X is above Y. I doesn't change.
+// (XO-CHIP)
+void Chip8::opcode5XY2() {
+    storeRegisterRange((opcode_ & 0x0F00) >> 8, (opcode_ & 0x00F0) >> 4);
+    pc_ += 2;
+}
+
+void Chip8::storeRegisterRange(unsigned int x, unsigned int y) {
+    const auto count = (x <= y ? y - x : x - y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        writeMemory(index_ + i, registers_[x <= y ? x + i : x - i]);
+    }
+}
+
+// 5XY3: Fills VX to VY with values from memory starting at address I, like 5XY2. (XO-CHIP)
+void Chip8::opcode5XY3() {
+    loadRegisterRange((opcode_ & 0x0F00) >> 8, (opcode_ & 0x00F0) >> 4);
+    pc_ += 2;
+}
+
+void Chip8::loadRegisterRange(unsigned int x, unsigned int y) {
+    const auto count = (x <= y ? y - x : x - y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        registers_[x <= y ? x + i : x - i] = memory_[(index_ + i) & (MEMORY_SIZE - 1)];
+    }
+}
+
 // 6XNN: Sets VX to NN
 void Chip8::opcode6XNN() {
     auto x = (opcode_ & 0x0F00) >> 8;
@@ -256,6 +799,9 @@ void Chip8::opcode8XY1() {
     auto y = (opcode_ & 0x00F0) >> 4;
 
     registers_[x] |= registers_[y];
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::VF_RESET)) {
+        registers_[0xF] = 0;
+    }
     pc_ += 2;
 }
 
@@ -265,6 +811,9 @@ void Chip8::opcode8XY2() {
     auto y = (opcode_ & 0x00F0) >> 4;
 
     registers_[x] &= registers_[y];
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::VF_RESET)) {
+        registers_[0xF] = 0;
+    }
     pc_ += 2;
 }
 
@@ -274,6 +823,9 @@ void Chip8::opcode8XY3() {
     auto y = (opcode_ & 0x00F0) >> 4;
 
     registers_[x] ^= registers_[y];
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::VF_RESET)) {
+        registers_[0xF] = 0;
+    }
     pc_ += 2;
 }
 
@@ -313,7 +865,7 @@ void Chip8::opcode8XY6() {
 
     registers_[0xF] = registers_[x] & 0x1;
 
-    if (mode_ == Mode::CHIP8) {
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::SHIFT_VY)) {
         // On CHIP8, shift VY and store the result in VX.
         // See: https://www.reddit.com/r/programming/comments/3ca4ry/writing_a_chip8_interpreteremulator_in_c14_10/csuepjm/
         auto y = (opcode_ & 0x00F0) >> 4;
@@ -346,7 +898,7 @@ void Chip8::opcode8XYE() {
 
     registers_[0xF] = registers_[x] >> 7;
 
-    if (mode_ == Mode::CHIP8) {
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::SHIFT_VY)) {
         // Check comment above for 8XY6 for an explanation why VY is shifted
         auto y = (opcode_ & 0x00F0) >> 4;
         registers_[x] = registers_[y] << 1;
@@ -363,7 +915,7 @@ void Chip8::opcode9XY0() {
     auto y = (opcode_ & 0x00F0) >> 4;
 
     if (registers_[x] != registers_[y]) {
-        pc_ += 4;
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
@@ -377,11 +929,12 @@ void Chip8::opcodeANNN() {
     pc_ += 2;
 }
 
-// BNNN: Jumps to the address NNN plus V0
+// BNNN: Jumps to the address NNN plus V0. With the jump quirk, this is BXNN instead, which jumps to XNN plus VX.
 void Chip8::opcodeBNNN() {
     auto address = opcode_ & 0x0FFF;
+    auto x = hasQuirk<RUNTIME_QUIRKS>(Quirk::JUMP_VX) ? (opcode_ & 0x0F00) >> 8 : 0;
 
-    pc_ = address + registers_[0];
+    pc_ = address + registers_[x];
     pc_ += 2;
 }
 
@@ -397,47 +950,98 @@ void Chip8::opcodeCXNN() {
 // DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8
 // pixels is read as bit-coded starting from memory location I; I value doesn’t change after the execution of this
 // instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite
-// is drawn, and to 0 if that doesn’t happen
+// is drawn, and to 0 if that doesn’t happen. On the SCHIP, DXY0 draws a 16x16 sprite made of 2 bytes per row.
 void Chip8::opcodeDXYN() {
-    auto vx = registers_[(opcode_ & 0x0F00) >> 8];
-    auto vy = registers_[(opcode_ & 0x00F0) >> 4];
-    auto height = opcode_ & 0x000F;
+    drawSprite<RUNTIME_QUIRKS>((opcode_ & 0x0F00) >> 8, (opcode_ & 0x00F0) >> 4, opcode_ & 0x000F);
+    pc_ += 2;
+}
+
+// With Clip set, the sprite starts at the wrapped position of VX and VY, and the parts of it which go past the edges of
+// the screen aren't drawn. Otherwise, they wrap around to the other side.
+template <bool Clip>
+void Chip8::blitSprite(unsigned int x, unsigned int y, unsigned int height) {
+    const auto width = video_.width;
+    const auto vx = registers_[x] % width;
+    const auto vy = registers_[y] % video_.height;
+
+    // DXY0 draws a 16x16 sprite on the SCHIP and XO-CHIP
+    const bool wide = height == 0 && (mode_ == Mode::SCHIP || mode_ == Mode::XOCHIP);
+    const unsigned int bytesPerRow = wide ? 2 : 1;
+    const auto spriteWidth = SPRITE_WIDTH * bytesPerRow;
+    if (wide) {
+        height = 16;
+    }
+
+    const auto mask = rowMask(width);
 
     // Set VF to 0 (for collision detection)
     registers_[0xF] = 0;
 
-    for (int yLine = 0; yLine < height; yLine++) {
-        auto spritePixel = memory_[index_ + yLine];
+    // Each selected plane gets its own sprite, stored in memory right after the sprite of the previous plane
+    auto spriteAddress = index_;
 
-        for (unsigned int xLine = 0; xLine < SPRITE_WIDTH; xLine++) {
-            // Check if sprite pixel is set to 1 (0x80 >> xLines iterates through the byte one bit at a time)
-            if (spritePixel & (0x80 >> xLine)) {
-                // Get pointer to pixel in video buffer.
-                // "% (VIDEO_WIDTH * VIDEO_HEIGHT)" is necessary for wrapping the sprite around.
-                auto *pixel = &video_[vx + xLine + ((vy + yLine) * VIDEO_WIDTH) % (VIDEO_WIDTH * VIDEO_HEIGHT)];
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(selectedPlanes_ & (1 << plane))) {
+            continue;
+        }
 
-                // Check collision
-                if (*pixel == 0xFFFFFFFF) {
-                    // Set VF to 1 (for collision detection)
-                    registers_[0xF] = 1;
+        for (unsigned int yLine = 0; yLine < height; yLine++) {
+            if (Clip && vy + yLine >= video_.height) {
+                break;
+            }
+
+            // I can point anywhere in the 16-bit address space, so addresses wrap around the end of memory
+            const auto address = spriteAddress + yLine * bytesPerRow;
+            uint64_t spriteBits = memory_[address & (MEMORY_SIZE - 1)];
+            if (wide) {
+                spriteBits = spriteBits << 8 | memory_[(address + 1) & (MEMORY_SIZE - 1)];
+            }
+
+            // Move the sprite to the left edge of a row, then right by VX. Without clipping, the pixels which went
+            // past the right edge wrap around to the left.
+            const VideoRow leftAligned{spriteBits << (64 - spriteWidth), 0};
+            auto spriteRow = shiftRowRight(leftAligned, vx);
+            if (!Clip && vx + spriteWidth > width) {
+                const auto wrapped = shiftRowLeft(leftAligned, width - vx);
+                for (unsigned int word = 0; word < VIDEO_ROW_WORDS; word++) {
+                    spriteRow[word] |= wrapped[word];
                 }
+            }
 
-                // Set value in video by XORing with 1
-                *pixel ^= 0xFFFFFFFF;
+            const auto row = (vy + yLine) % video_.height;
+            auto &videoRow = video_.planes[plane][row];
+
+            // Check collision, then set the pixels by XORing whole words at once
+            uint64_t changed = 0;
+            for (unsigned int word = 0; word < VIDEO_ROW_WORDS; word++) {
+                const auto bits = spriteRow[word] & mask[word];
+                if (videoRow[word] & bits) {
+                    registers_[0xF] = 1;
+                }
+                videoRow[word] ^= bits;
+                changed |= bits;
+            }
+            if (changed != 0) {
+                dirtyRows_ |= uint64_t{1} << row;
             }
         }
+
+        spriteAddress += height * bytesPerRow;
     }
 
     drawFlag_ = true;
-    pc_ += 2;
 }
 
+template void Chip8::blitSprite<true>(unsigned int x, unsigned int y, unsigned int height);
+
+template void Chip8::blitSprite<false>(unsigned int x, unsigned int y, unsigned int height);
+
 // EX9E: Skips the next instruction if the key stored in VX is pressed
 void Chip8::opcodeEX9E() {
     auto x = (opcode_ & 0x0F00) >> 8;
 
-    if (keys_[registers_[x]]) {
-        pc_ += 4;
+    if (keyPressed(registers_[x])) {
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
@@ -447,13 +1051,38 @@ void Chip8::opcodeEX9E() {
 void Chip8::opcodeEXA1() {
     auto x = (opcode_ & 0x0F00) >> 8;
 
-    if (keys_[registers_[x]] == 0) {
-        pc_ += 4;
+    if (!keyPressed(registers_[x])) {
+        pc_ += skipLength();
     } else {
         pc_ += 2;
     }
 }
 
+// F000 NNNN: Sets I to the 16-bit address NNNN in the next word (XO-CHIP)
+void Chip8::opcodeF000() {
+    index_ = memory_[(pc_ + 2) & (MEMORY_SIZE - 1)] << 8 | memory_[(pc_ + 3) & (MEMORY_SIZE - 1)];
+    pc_ += 4;
+}
+
+// FN01: Selects the bitplanes drawn to by DXYN, 00E0 and the scroll opcodes. N has one bit per plane. (XO-CHIP)
+void Chip8::opcodeFN01() {
+    selectedPlanes_ = (opcode_ & 0x0F00) >> 8;
+    pc_ += 2;
+}
+
+// F002: Loads the 16 byte audio pattern from memory starting at address I (XO-CHIP)
+void Chip8::opcodeF002() {
+    loadAudioPattern();
+    pc_ += 2;
+}
+
+void Chip8::loadAudioPattern() {
+    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+        audioPattern_.samples[i] = memory_[(index_ + i) & (MEMORY_SIZE - 1)];
+    }
+    audioPattern_.loaded = true;
+}
+
 // FX07: Sets VX to the value of the delay timer
 void Chip8::opcodeFX07() {
     auto x = (opcode_ & 0x0F00) >> 8;
@@ -466,21 +1095,15 @@ void Chip8::opcodeFX07() {
 void Chip8::opcodeFX0A() {
     auto x = (opcode_ & 0x0F00) >> 8;
 
-    bool keyPress = false;
-
-    for (unsigned int i = 0; i < KEY_COUNT; i++) {
-        if (keys_[i]) {
-            registers_[x] = i;
-            keyPress = true;
-        }
-    }
+    const auto key = highestPressedKey();
 
-    if (!keyPress) {
+    if (key < 0) {
         // Don't increment PC, which will lead the emulator to come back to this instruction.
         return;
     }
 
     // Only increment pc if a key is pressed
+    registers_[x] = static_cast<uint8_t>(key);
     pc_ += 2;
 }
 
@@ -522,51 +1145,98 @@ void Chip8::opcodeFX29() {
     pc_ += 2;
 }
 
+// FX30: Sets I to the location of the 8x10 sprite for the character in VX (SCHIP)
+void Chip8::opcodeFX30() {
+    auto x = (opcode_ & 0x0F00) >> 8;
+
+    index_ = BIG_FONT_SET_START_ADDRESS + registers_[x] * BIG_CHARACTER_SPRITE_WIDTH;
+    pc_ += 2;
+}
+
 // FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I plus 2
 void Chip8::opcodeFX33() {
-    auto vx = registers_[(opcode_ & 0x0F00) >> 8];
+    storeBcd((opcode_ & 0x0F00) >> 8);
+    pc_ += 2;
+}
 
-    memory_[index_] = vx / 100; // Hundreds place
-    memory_[index_ + 1] = (vx / 10) % 10; // Tens place
-    memory_[index_ + 2] = (vx % 100) % 10; // Ones place
+// FX3A: Sets the pitch of the audio pattern to VX (XO-CHIP)
+void Chip8::opcodeFX3A() {
+    auto x = (opcode_ & 0x0F00) >> 8;
 
+    audioPattern_.pitch = registers_[x];
     pc_ += 2;
 }
 
+void Chip8::storeBcd(unsigned int x) {
+    auto vx = registers_[x];
+
+    writeMemory(index_, vx / 100); // Hundreds place
+    writeMemory(index_ + 1, (vx / 10) % 10); // Tens place
+    writeMemory(index_ + 2, (vx % 100) % 10); // Ones place
+}
+
 // FX55: Stores V0 to VX (including VX) in memory starting at address I.
 void Chip8::opcodeFX55() {
     auto x = (opcode_ & 0x0F00) >> 8;
 
-    for (int i = 0; i <= x; i++) {
-        memory_[index_ + i] = registers_[i];
+    storeRegisters(x);
 
-        if (mode_ == Mode::CHIP8 || mode_ == Mode::CHIP48) {
-            // On CHIP-8 and CHIP-48, the index is incremented by the number of bytes loaded or stored. Most ROMs
-            // however don't assume this behaviour, so by default this is ignored (like on the SCHIP).
-            // See: https://en.wikipedia.org/wiki/CHIP-8#cite_note-increment-10
-            // And: https://www.reddit.com/r/programming/comments/3ca4ry/writing_a_chip8_interpreteremulator_in_c14_10/csuepjm/
-            // And: https://github.com/Chromatophore/HP48-Superchip/blob/master/investigations/quirk_i.md
-            index_ += registers_[i];
-        }
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::LOAD_STORE_INCREMENT)) {
+        // On CHIP-8 and CHIP-48, the index is incremented by the number of bytes loaded or stored. Most ROMs
+        // however don't assume this behaviour, so by default this is ignored (like on the SCHIP).
+        // See: https://en.wikipedia.org/wiki/CHIP-8#cite_note-increment-10
+        // And: https://www.reddit.com/r/programming/comments/3ca4ry/writing_a_chip8_interpreteremulator_in_c14_10/csuepjm/
+        // And: https://github.com/Chromatophore/HP48-Superchip/blob/master/investigations/quirk_i.md
+        index_ += x + 1;
     }
-
     pc_ += 2;
 }
 
+void Chip8::storeRegisters(unsigned int x) {
+    for (unsigned int i = 0; i <= x; i++) {
+        writeMemory(index_ + i, registers_[i]);
+    }
+}
+
 // FX65: Fills V0 to VX (including VX) with values from memory starting at address I.
 void Chip8::opcodeFX65() {
-    for (unsigned int i = 0; i <= ((opcode_ & 0x0F00) >> 8); i++) {
-        registers_[i] = memory_[index_ + i];
+    auto x = (opcode_ & 0x0F00) >> 8;
 
-        if (mode_ == Mode::CHIP8 || mode_ == Mode::CHIP48) {
-            // Check comment above for FX55 for an explanation why this is incremented.
-            index_ += memory_[index_ + i];
-        }
+    loadRegisters(x);
+
+    if (hasQuirk<RUNTIME_QUIRKS>(Quirk::LOAD_STORE_INCREMENT)) {
+        // Check comment above for FX55 for an explanation why this is incremented.
+        index_ += x + 1;
     }
+    pc_ += 2;
+}
+
+void Chip8::loadRegisters(unsigned int x) {
+    for (unsigned int i = 0; i <= x; i++) {
+        registers_[i] = memory_[(index_ + i) & (MEMORY_SIZE - 1)];
+    }
+}
 
+// FX75: Stores V0 to VX (including VX) in the RPL flags (SCHIP)
+void Chip8::opcodeFX75() {
+    storeRplFlags((opcode_ & 0x0F00) >> 8);
     pc_ += 2;
 }
 
+void Chip8::storeRplFlags(unsigned int x) {
+    std::copy(registers_.begin(), registers_.begin() + x + 1, rplFlags_.begin());
+}
+
+// FX85: Fills V0 to VX (including VX) with values from the RPL flags (SCHIP)
+void Chip8::opcodeFX85() {
+    loadRplFlags((opcode_ & 0x0F00) >> 8);
+    pc_ += 2;
+}
+
+void Chip8::loadRplFlags(unsigned int x) {
+    std::copy(rplFlags_.begin(), rplFlags_.begin() + x + 1, registers_.begin());
+}
+
 void Chip8::loadRom(const std::string &filepath) {
     std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
     if (!ifs) {
@@ -578,7 +1248,7 @@ void Chip8::loadRom(const std::string &filepath) {
     auto size = std::size_t(end - ifs.tellg());
     if (size == 0) {
         throw std::runtime_error("Specified ROM has a size of 0.");
-    } else if (size > MEMORY_SIZE - ROM_START_ADDRESS) {
+    } else if (size > (mode_ == Mode::XOCHIP ? MEMORY_SIZE : CHIP8_MEMORY_SIZE) - ROM_START_ADDRESS) {
         throw std::runtime_error("ROM too big for memory");
     }
 
@@ -586,10 +1256,196 @@ void Chip8::loadRom(const std::string &filepath) {
     for (long long unsigned int i = 0; i < size; i++) {
         memory_[i + ROM_START_ADDRESS] = buffer[i];
     }
+    std::fill(instructionCache_.begin(), instructionCache_.end(), Instruction{});
+    flushBlocks();
+
+    if (engine_ == Engine::AOT) {
+        aotProgram_ = findAotProgram(memory_.data() + ROM_START_ADDRESS, size);
+        if (!aotProgram_) {
+            std::cerr << "No translated program found for " << filepath << ", using the switch engine instead\n";
+        }
+    }
+    aotStale_.reset();
+    aotStaleCode_ = 0;
 
     ifs.close();
 }
 
+// The state is laid out as follows, with every value in little-endian byte order:
+// - Header: SAVE_STATE_MAGIC, SAVE_STATE_VERSION (16 bits), mode and quirks (8 bits each)
+// - All of memory, then V0 to VF
+// - The stack (16 bits per entry), stack pointer, I, pc and current opcode (16 bits each)
+// - Delay and sound timers (8 bits each). The keys aren't saved, since they're whatever is held down when loading.
+// - Screen width and height (8 bits each), then every plane row by row, 64 bits per word
+// - RPL flags, selected planes, audio pattern, pitch and whether it's loaded (8 bits each)
+// - Instructions left until the next timer tick and the state of the random number generator (32 bits each)
+// The rows of a plane are copied as one array of words
+static_assert(sizeof(VideoPlane) == HIRES_VIDEO_HEIGHT * VIDEO_ROW_WORDS * sizeof(uint64_t));
+
+void Chip8::saveState(SaveState &state) const {
+    StateWriter writer{state};
+
+    writer.putBytes(SAVE_STATE_MAGIC.data(), SAVE_STATE_MAGIC.size());
+    writer.put<uint16_t>(SAVE_STATE_VERSION);
+    writer.put<uint8_t>(static_cast<uint8_t>(mode_));
+    writer.put<uint8_t>(quirks_);
+
+    writer.putBytes(memory_.data(), memory_.size());
+    writer.putBytes(registers_.data(), registers_.size());
+    for (auto address : stack_) {
+        writer.put(address);
+    }
+    writer.put(sp_);
+    writer.put(index_);
+    writer.put(pc_);
+    writer.put(opcode_);
+
+    writer.put(delayTimer_);
+    writer.put(soundTimer_);
+
+    writer.put<uint8_t>(video_.width);
+    writer.put<uint8_t>(video_.height);
+    for (const auto &plane : video_.planes) {
+        writer.putArray(plane[0].data(), HIRES_VIDEO_HEIGHT * VIDEO_ROW_WORDS);
+    }
+
+    writer.putBytes(rplFlags_.data(), rplFlags_.size());
+    writer.put(selectedPlanes_);
+    writer.putBytes(audioPattern_.samples.data(), audioPattern_.samples.size());
+    writer.put(audioPattern_.pitch);
+    writer.put<uint8_t>(audioPattern_.loaded);
+
+    writer.put<uint32_t>(cyclesUntilTimerTick_);
+    writer.put<uint32_t>(randEngine_.state());
+
+    if (!writer.full()) {
+        throw std::logic_error("Save state layout doesn't match SAVE_STATE_SIZE");
+    }
+}
+
+void Chip8::loadState(const SaveState &state) {
+    StateReader reader{state};
+
+    if (std::memcmp(reader.data(), SAVE_STATE_MAGIC.data(), SAVE_STATE_MAGIC.size()) != 0) {
+        throw std::runtime_error("Not a save state");
+    }
+    reader.skip(SAVE_STATE_MAGIC.size());
+    const auto version = reader.get<uint16_t>();
+    if (version != SAVE_STATE_VERSION) {
+        throw std::runtime_error("Unsupported save state version: " + std::to_string(version));
+    }
+    const auto mode = reader.get<uint8_t>();
+    const auto quirks = reader.get<uint8_t>();
+    if (mode != static_cast<uint8_t>(mode_) || quirks != quirks_) {
+        throw std::runtime_error("Save state was made with a different mode or different quirks");
+    }
+
+    // Memory is compared a chunk at a time, and only the bytes which differ are written, so that only the code they
+    // overlap is decoded and compiled again
+    const auto *memory = reader.data();
+    const unsigned int chunkSize = 256;
+    for (unsigned int address = 0; address < MEMORY_SIZE; address += chunkSize) {
+        if (std::memcmp(&memory_[address], memory + address, chunkSize) != 0) {
+            for (unsigned int i = address; i < address + chunkSize; i++) {
+                if (memory_[i] != memory[i]) {
+                    writeMemory(i, memory[i]);
+                }
+            }
+        }
+    }
+    reader.skip(MEMORY_SIZE);
+
+    reader.getBytes(registers_.data(), registers_.size());
+    for (auto &address : stack_) {
+        address = reader.get<uint16_t>();
+    }
+    sp_ = reader.get<uint16_t>() & (STACK_SIZE - 1);
+    index_ = reader.get<uint16_t>();
+    pc_ = reader.get<uint16_t>();
+    opcode_ = reader.get<uint16_t>();
+
+    delayTimer_ = reader.get<uint8_t>();
+    soundTimer_ = reader.get<uint8_t>();
+
+    // Anything other than the high resolution is read as the low resolution, so the rows always fit in the planes
+    const bool highResolution = reader.get<uint8_t>() == HIRES_VIDEO_WIDTH;
+    reader.skip(1);
+    const auto previousWidth = video_.width;
+    const auto previousPlanes = video_.planes;
+    video_.width = highResolution ? HIRES_VIDEO_WIDTH : VIDEO_WIDTH;
+    video_.height = highResolution ? HIRES_VIDEO_HEIGHT : VIDEO_HEIGHT;
+    for (auto &plane : video_.planes) {
+        reader.getArray(plane[0].data(), HIRES_VIDEO_HEIGHT * VIDEO_ROW_WORDS);
+    }
+
+    // Only the rows which differ from the state are dirty, so that restoring a state that was just saved, as run-ahead
+    // does, only redraws what changed in between
+    if (video_.width != previousWidth) {
+        dirtyRows_ = allRows(video_.height);
+    } else {
+        for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+            for (unsigned int y = 0; y < video_.height; y++) {
+                if (video_.planes[plane][y] != previousPlanes[plane][y]) {
+                    dirtyRows_ |= uint64_t{1} << y;
+                }
+            }
+        }
+    }
+
+    reader.getBytes(rplFlags_.data(), rplFlags_.size());
+    selectedPlanes_ = reader.get<uint8_t>() & ((1 << PLANE_COUNT) - 1);
+    reader.getBytes(audioPattern_.samples.data(), audioPattern_.samples.size());
+    audioPattern_.pitch = reader.get<uint8_t>();
+    audioPattern_.loaded = reader.get<uint8_t>() != 0;
+
+    // The state may come from a machine with a different CPU frequency
+    const auto cyclesUntilTimerTick = reader.get<uint32_t>();
+    cyclesUntilTimerTick_ = cyclesUntilTimerTick != 0 && cyclesUntilTimerTick <= cyclesPerTimerTick_
+                            ? cyclesUntilTimerTick : cyclesPerTimerTick_;
+    randEngine_.seed(reader.get<uint32_t>());
+
+    // The restored screen hasn't been presented yet
+    drawFlag_ = true;
+}
+
+void Chip8::writeMemory(unsigned int address, uint8_t value) {
+    address &= MEMORY_SIZE - 1;
+
+    // ROMs often store the same values again, which leaves all the decoded code as it is
+    if (memory_[address] == value) {
+        return;
+    }
+    memory_[address] = value;
+    invalidateInstructionCache(address);
+
+    if (blockCode_.test(address)) {
+        invalidateBlocks(address);
+    }
+
+    if (jit_) {
+        jit_->invalidate(address);
+    }
+
+    if (aotProgram_ && address >= ROM_START_ADDRESS && address - ROM_START_ADDRESS < aotProgram_->romSize) {
+        const auto offset = address - ROM_START_ADDRESS;
+        const bool stale = value != aotProgram_->rom[offset];
+        if (stale != aotStale_.test(address) && aotProgram_->code[offset] != 0) {
+            aotStaleCode_ = stale ? aotStaleCode_ + 1 : aotStaleCode_ - 1;
+        }
+        aotStale_.set(address, stale);
+    }
+}
+
+// Drops the cached instructions overlapping a written address, so that ROMs which modify their own code get decoded
+// again. An instruction is two bytes long, so it overlaps the written address if it starts there or one byte before.
+// The address has already been masked by writeMemory.
+void Chip8::invalidateInstructionCache(unsigned int address) {
+    instructionCache_[address].op = Op::UNDECODED;
+    if (address > 0) {
+        instructionCache_[address - 1].op = Op::UNDECODED;
+    }
+}
+
 bool Chip8::drawFlag() const {
     return drawFlag_;
 }
@@ -598,22 +1454,125 @@ void Chip8::disableDrawFlag() {
     drawFlag_ = false;
 }
 
+// Only the selected planes are cleared and scrolled. Either marks every row as dirty.
 void Chip8::clearScreen() {
-    video_.fill(0);
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (selectedPlanes_ & (1 << plane)) {
+            video_.planes[plane].fill({});
+        }
+    }
+    dirtyRows_ |= allRows(video_.height);
+}
+
+// Both resolutions share the same rows, so every plane is cleared when switching to keep pixels off screen at 0
+void Chip8::setHighResolution(bool enabled) {
+    video_.width = enabled ? HIRES_VIDEO_WIDTH : VIDEO_WIDTH;
+    video_.height = enabled ? HIRES_VIDEO_HEIGHT : VIDEO_HEIGHT;
+    video_.planes.fill({});
+    dirtyRows_ = allRows(video_.height);
+}
+
+// Scrolling moves whole rows, or shifts whole words of each row, rather than going through single pixels
+void Chip8::scrollDown(unsigned int rows) {
+    rows = std::min(rows, video_.height);
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (selectedPlanes_ & (1 << plane)) {
+            const auto first = video_.planes[plane].begin();
+            const auto last = first + video_.height;
+            std::move_backward(first, last - rows, last);
+            std::fill(first, first + rows, VideoRow{});
+        }
+    }
+    dirtyRows_ |= allRows(video_.height);
+}
+
+void Chip8::scrollUp(unsigned int rows) {
+    rows = std::min(rows, video_.height);
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (selectedPlanes_ & (1 << plane)) {
+            const auto first = video_.planes[plane].begin();
+            const auto last = first + video_.height;
+            std::move(first + rows, last, first);
+            std::fill(last - rows, last, VideoRow{});
+        }
+    }
+    dirtyRows_ |= allRows(video_.height);
+}
+
+void Chip8::scrollRight(unsigned int pixels) {
+    const auto mask = rowMask(video_.width);
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (selectedPlanes_ & (1 << plane)) {
+            for (unsigned int y = 0; y < video_.height; y++) {
+                auto &row = video_.planes[plane][y];
+                row = shiftRowRight(row, pixels);
+                for (unsigned int word = 0; word < VIDEO_ROW_WORDS; word++) {
+                    row[word] &= mask[word];
+                }
+            }
+        }
+    }
+    dirtyRows_ |= allRows(video_.height);
 }
 
-const std::array<uint32_t, VIDEO_WIDTH * VIDEO_HEIGHT> &Chip8::video() const {
+void Chip8::scrollLeft(unsigned int pixels) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (selectedPlanes_ & (1 << plane)) {
+            for (unsigned int y = 0; y < video_.height; y++) {
+                video_.planes[plane][y] = shiftRowLeft(video_.planes[plane][y], pixels);
+            }
+        }
+    }
+    dirtyRows_ |= allRows(video_.height);
+}
+
+const Video &Chip8::video() const {
     return video_;
 }
 
-std::array<uint8_t, KEY_COUNT> &Chip8::keys() {
-    return keys_;
+uint64_t Chip8::dirtyRows() const {
+    return dirtyRows_;
+}
+
+void Chip8::clearDirtyRows() {
+    dirtyRows_ = 0;
+}
+
+const AudioPattern &Chip8::audioPattern() const {
+    return audioPattern_;
+}
+
+uint16_t Chip8::keys() const {
+    return keys_.load(std::memory_order_relaxed);
+}
+
+void Chip8::setKeys(uint16_t keys) {
+    keys_.store(keys, std::memory_order_relaxed);
+}
+
+void Chip8::setKey(unsigned int key, bool pressed) {
+    const auto bit = static_cast<uint16_t>(1 << (key & 0xF));
+    if (pressed) {
+        keys_.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+        keys_.fetch_and(static_cast<uint16_t>(~bit), std::memory_order_relaxed);
+    }
+}
+
+bool Chip8::soundActive() const {
+    return soundTimer_ > 0;
 }
 
-bool Chip8::soundFlag() const {
-    return soundFlag_;
+bool Chip8::operator==(const Chip8 &other) const {
+    return memory_ == other.memory_ && registers_ == other.registers_ && index_ == other.index_ &&
+           pc_ == other.pc_ && stack_ == other.stack_ && sp_ == other.sp_ && delayTimer_ == other.delayTimer_ &&
+           soundTimer_ == other.soundTimer_ && video_ == other.video_ && rplFlags_ == other.rplFlags_ &&
+           selectedPlanes_ == other.selectedPlanes_ && audioPattern_ == other.audioPattern_;
 }
 
-void Chip8::disableSoundFlag() {
-    soundFlag_ = false;
+bool Chip8::operator!=(const Chip8 &other) const {
+    return !(*this == other);
 }
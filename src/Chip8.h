@@ -1,45 +1,211 @@
 #pragma once
 
+#include "Aot.h"
+#include "AudioPattern.h"
 #include "Constants.h"
+#include "Engine.h"
+#include "Instruction.h"
+#include "Jit.h"
 #include "Mode.h"
-#include "Timer.h"
+#include "Quirks.h"
+#include "Random.h"
+#include "Video.h"
 
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <memory>
+#include <utility>
 #include <string>
 #include <random>
+#include <vector>
 
-const unsigned int MEMORY_SIZE = 4096;
+// The XO-CHIP has 64 KB of memory. The other machines only have 4 KB, which limits the size of their ROMs.
+const unsigned int MEMORY_SIZE = 0x10000;
+const unsigned int CHIP8_MEMORY_SIZE = 0x1000;
 const unsigned int REGISTER_COUNT = 16;
 const unsigned int STACK_SIZE = 16;
 const unsigned int FONT_SET_SIZE = 80;
+const unsigned int ROM_START_ADDRESS = 0x200;
+const unsigned int FONT_SET_START_ADDRESS = 0x050;
+const unsigned int CHARACTER_SPRITE_WIDTH = 0x5;
+const unsigned int BIG_FONT_SET_SIZE = 160;
+const unsigned int BIG_FONT_SET_START_ADDRESS = FONT_SET_START_ADDRESS + FONT_SET_SIZE;
+const unsigned int BIG_CHARACTER_SPRITE_WIDTH = 10;
+const unsigned int RPL_FLAG_COUNT = 16;
+
+// Size of a save state, laid out as described in saveState
+const std::size_t SAVE_STATE_SIZE = 8 + MEMORY_SIZE + REGISTER_COUNT + STACK_SIZE * 2 + 8 + 2 + 2 +
+                                    PLANE_COUNT * HIRES_VIDEO_HEIGHT * VIDEO_ROW_WORDS * 8 + RPL_FLAG_COUNT + 1 +
+                                    AUDIO_PATTERN_SIZE + 2 + 8;
+
+// About 70 KB, so keep these off the stack
+using SaveState = std::array<uint8_t, SAVE_STATE_SIZE>;
 
 class Chip8 {
 public:
-    explicit Chip8(Mode mode);
+    // The given quirks are enabled on top of the ones of the mode. The engine is specialised for the resulting set of
+    // quirks, so that they cost nothing while running.
+    // Timers are ticked after every cyclesPerTimerTick instructions. If 0 is passed in, the timers are only ticked
+    // when tick() is called, which lets the host drive them from its own clock.
+    Chip8(Mode mode, Quirks quirks, Engine engine, unsigned int cyclesPerTimerTick);
 
     void reset();
 
+    void seed(unsigned int seed);
+
     void cycle();
 
+    // Executes the given number of instructions. Unlike calling cycle() in a loop, this lets the block engine execute
+    // whole blocks at a time.
+    void run(unsigned int cycles);
+
+    void tick();
+
+    // How many of the next maxCycles instructions can be skipped because the machine is idle: blocked on FX0A, halted,
+    // or in a short loop which only polls the delay timer or the keys. Only whole iterations of the loop are counted,
+    // up to the next timer tick, so skipping them leaves the machine exactly as running them would. Returns 0 when the
+    // machine isn't idle.
+    [[nodiscard]] unsigned int idleCycles(unsigned int maxCycles) const;
+
+    // Skips cycles counted by idleCycles, ticking the timers if the next tick is reached
+    void skipIdleCycles(unsigned int cycles);
+
     void loadRom(const std::string &filepath);
 
-    std::array<uint8_t, KEY_COUNT> &keys();
+    // Snapshots the whole machine into a state, and restores it again. Neither allocates, and restoring only
+    // invalidates the decoded code covering memory which differs from the state. A state can be restored into any
+    // engine, but only with the same mode and quirks it was saved with.
+    void saveState(SaveState &state) const;
+
+    void loadState(const SaveState &state);
+
+    // The keypad, with one bit per key and key 0 as the lowest bit. Keys can be pressed and released from any thread,
+    // and the engines see the change from the next instruction on.
+    [[nodiscard]] uint16_t keys() const;
+
+    void setKeys(uint16_t keys);
+
+    void setKey(unsigned int key, bool pressed);
 
-    [[nodiscard]] const std::array<uint32_t, VIDEO_WIDTH * VIDEO_HEIGHT> &video() const;
+    [[nodiscard]] const Video &video() const;
+
+    // Rows of the screen which changed since the last call to clearDirtyRows, with row 0 as the lowest bit. Every row
+    // on screen is dirty after the resolution changes, so consumers can redraw or encode only the rows in here.
+    [[nodiscard]] uint64_t dirtyRows() const;
+
+    void clearDirtyRows();
+
+    [[nodiscard]] const AudioPattern &audioPattern() const;
 
     [[nodiscard]] bool drawFlag() const;
 
     void disableDrawFlag();
 
-    [[nodiscard]] bool soundFlag() const;
+    // The buzzer sounds for as long as the sound timer is above 0
+    [[nodiscard]] bool soundActive() const;
 
-    void disableSoundFlag();
+    // Compares the emulated machine state, so that engines can be checked against each other
+    bool operator==(const Chip8 &other) const;
+
+    bool operator!=(const Chip8 &other) const;
 
 private:
+    struct EngineFunctions {
+        void (Chip8::*cycle)();
+        void (Chip8::*run)(unsigned int cycles);
+    };
+
+    template <Quirks Q>
+    static EngineFunctions engineFunctions(Engine engine);
+
+    template <std::size_t... Q>
+    static EngineFunctions selectEngine(Engine engine, Quirks quirks, std::index_sequence<Q...>);
+
+    template <Quirks Q>
+    [[nodiscard]] bool hasQuirk(Quirk quirk) const;
+
     void clearScreen();
 
+    void setHighResolution(bool enabled);
+
+    void scrollDown(unsigned int rows);
+
+    void scrollUp(unsigned int rows);
+
+    void scrollRight(unsigned int pixels);
+
+    void scrollLeft(unsigned int pixels);
+
+    void cycleTable();
+
+    void runTable(unsigned int cycles);
+
+    template <Quirks Q>
+    void cycleSwitch();
+
+    template <Quirks Q>
+    void runSwitch(unsigned int cycles);
+
+    template <Quirks Q>
+    void runBlocks(unsigned int cycles);
+
+    Block buildBlock(unsigned int address);
+
+    template <Quirks Q>
+    void runJit(unsigned int cycles);
+
+    template <Quirks Q>
+    void runAot(unsigned int cycles);
+
+    void invalidateBlocks(unsigned int address);
+
+    void flushBlocks();
+
+    void countCycles(unsigned int cycles);
+
+    [[nodiscard]] unsigned int idleLoopLength() const;
+
+    template <Quirks Q>
+    unsigned int execute(const Instruction &instruction);
+
+    template <Quirks Q>
+    void drawSprite(unsigned int x, unsigned int y, unsigned int height);
+
+    template <bool Clip>
+    void blitSprite(unsigned int x, unsigned int y, unsigned int height);
+
+    [[nodiscard]] unsigned int skipLength() const;
+
+    [[nodiscard]] bool keyPressed(unsigned int key) const;
+
+    [[nodiscard]] int highestPressedKey() const;
+
+    void storeBcd(unsigned int x);
+
+    void storeRegisters(unsigned int x);
+
+    void loadRegisters(unsigned int x);
+
+    void storeRegisterRange(unsigned int x, unsigned int y);
+
+    void loadRegisterRange(unsigned int x, unsigned int y);
+
+    void loadAudioPattern();
+
+    void storeRplFlags(unsigned int x);
+
+    void loadRplFlags(unsigned int x);
+
+    void writeMemory(unsigned int address, uint8_t value);
+
+    void invalidateInstructionCache(unsigned int address);
+
     void decodeFuncTable0();
 
+    void decodeFuncTable5();
+
     void decodeFuncTable8();
 
     void decodeFuncTableE();
@@ -52,6 +218,20 @@ private:
 
     void opcode00EE();
 
+    void opcode00CN();
+
+    void opcode00DN();
+
+    void opcode00FB();
+
+    void opcode00FC();
+
+    void opcode00FD();
+
+    void opcode00FE();
+
+    void opcode00FF();
+
     void opcode1NNN();
 
     void opcode2NNN();
@@ -62,6 +242,10 @@ private:
 
     void opcode5XY0();
 
+    void opcode5XY2();
+
+    void opcode5XY3();
+
     void opcode6XNN();
 
     void opcode7XNN();
@@ -98,6 +282,12 @@ private:
 
     void opcodeEXA1();
 
+    void opcodeF000();
+
+    void opcodeFN01();
+
+    void opcodeF002();
+
     void opcodeFX07();
 
     void opcodeFX0A();
@@ -112,10 +302,18 @@ private:
 
     void opcodeFX33();
 
+    void opcodeFX3A();
+
     void opcodeFX55();
 
     void opcodeFX65();
 
+    void opcodeFX30();
+
+    void opcodeFX75();
+
+    void opcodeFX85();
+
     std::array<uint8_t, MEMORY_SIZE> memory_;
     std::array<uint8_t, REGISTER_COUNT> registers_;
     uint16_t opcode_;
@@ -125,27 +323,62 @@ private:
     std::array<uint16_t, STACK_SIZE> stack_;
     uint16_t sp_;
 
-    std::array<uint32_t, VIDEO_WIDTH * VIDEO_HEIGHT> video_; // uint32_t used to work well with SDL
+    Video video_; // Expanded into pixels only when presented
+    uint64_t dirtyRows_;
+
+    // SCHIP persistent flag registers, which are kept across resets like on the HP-48
+    std::array<uint8_t, RPL_FLAG_COUNT> rplFlags_;
+
+    uint8_t selectedPlanes_; // Bitplanes drawn to, one bit per plane (XO-CHIP)
+    AudioPattern audioPattern_;
 
     uint8_t delayTimer_;
     uint8_t soundTimer_;
 
-    std::array<uint8_t, KEY_COUNT> keys_;
+    std::atomic<uint16_t> keys_;
 
     bool drawFlag_;
-    bool soundFlag_;
 
     const Mode mode_; // Specify whether to execute instructions like on the CHIP-8, CHIP-48 or SCHIP
-
-    std::default_random_engine randEngine_;
+    const Quirks quirks_;
+    const Engine engine_;
+    const EngineFunctions engineFunctions_;
+    const std::array<Instruction, OPCODE_COUNT> &decodeTable_;
+
+    // Decoded instruction at each address in memory, filled in the first time the address is executed. This and the
+    // blocks are on the heap, as they're too big for the stack with 64 KB of memory.
+    std::vector<Instruction> instructionCache_;
+
+    // Blocks built by the block engine, indexed by their start address. blockCode_ marks every byte covered by a block,
+    // and may still mark bytes of blocks which have since been dropped.
+    std::vector<Block> blocks_;
+    std::vector<Instruction> blockInstructions_;
+    std::bitset<MEMORY_SIZE> blockCode_;
+
+    // Only created for the JIT engine
+    std::unique_ptr<Jit> jit_;
+
+    // Program translated from the loaded ROM by chip8_aot, if the AOT engine is used and one was linked in.
+    // aotStale_ marks the bytes of the ROM which have been overwritten with different values since it was loaded, and
+    // aotStaleCode_ counts those which belong to translated instructions. Writes to data leave the translation intact.
+    const AotProgram *aotProgram_;
+    std::bitset<MEMORY_SIZE> aotStale_;
+    unsigned int aotStaleCode_;
+
+    RandomEngine randEngine_;
     std::uniform_int_distribution<uint8_t> randByte_;
 
-    Timer timer_;
+    // Virtual time base for the 60 Hz delay and sound timers, counted in emulated instructions
+    const unsigned int cyclesPerTimerTick_;
+    unsigned int cyclesUntilTimerTick_;
+
+    friend class AotRuntime;
 
     using chip8Func = void (Chip8::*)();
     chip8Func funcTable_[0xF + 1]{&Chip8::opcodeUnknown};
-    chip8Func funcTable0_[0xE + 1]{&Chip8::opcodeUnknown};
-    chip8Func funcTable8_[0xE + 1]{&Chip8::opcodeUnknown};
-    chip8Func funcTableE_[0xE + 1]{&Chip8::opcodeUnknown};
-    chip8Func funcTableF_[0x65 + 1]{&Chip8::opcodeUnknown};
+    chip8Func funcTable0_[0xFF + 1]{&Chip8::opcodeUnknown};
+    chip8Func funcTable5_[0xF + 1]{&Chip8::opcodeUnknown};
+    chip8Func funcTable8_[0xF + 1]{&Chip8::opcodeUnknown};
+    chip8Func funcTableE_[0xF + 1]{&Chip8::opcodeUnknown};
+    chip8Func funcTableF_[0xFF + 1]{&Chip8::opcodeUnknown};
 };
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Video.h"
+
+enum class ColourScheme {
+    DEFAULT, // White on black
+    AMBER, // Amber on black, like a monochrome monitor
+    GREEN, // Green on black, like a phosphor monitor
+    LCD // Dark green on light green, like an early handheld's screen
+};
+
+// The schemes only change the colours of pixels which are on or off in the first plane. The other XO-CHIP colours stay
+// the same.
+inline Palette schemePalette(ColourScheme scheme) {
+    auto palette = PALETTE;
+    switch (scheme) {
+        case ColourScheme::AMBER:
+            palette[0] = 0x1A0F00FF;
+            palette[1] = 0xFFB000FF;
+            break;
+        case ColourScheme::GREEN:
+            palette[0] = 0x001400FF;
+            palette[1] = 0x33FF33FF;
+            break;
+        case ColourScheme::LCD:
+            palette[0] = 0x9BBC0FFF;
+            palette[1] = 0x0F380FFF;
+            break;
+        default:
+            break;
+    }
+    return palette;
+}
@@ -1,16 +1,43 @@
 #pragma once
 
+#include "CaptureFormat.h"
+#include "ColourScheme.h"
 #include "Constants.h"
+#include "Engine.h"
+#include "Filter.h"
 #include "Mode.h"
+#include "Quirks.h"
 
 #include <string>
 
+// Each frame of run-ahead emulates that many more frames every frame
+const int MAX_RUN_AHEAD = 4;
+
 struct Config {
-    Config() : romPath_{}, videoScale_{15}, cpuFrequency_{1000}, mute_{false}, mode_{Mode::SCHIP} {}
+    Config() : romPath_{}, videoScale_{15}, filter_{Filter::NONE}, colourScheme_{ColourScheme::DEFAULT},
+               cpuFrequency_{1000}, mute_{false}, mode_{Mode::SCHIP}, quirks_{0},
+               engine_{Engine::SWITCH}, runAhead_{0},
+               showTiming_{false}, audioSync_{false}, capturePath_{}, captureFormat_{CaptureFormat::Y4M},
+               captureFrames_{3600}, captureSkipDuplicates_{false}, terminal_{false}, terminalFrameRate_{30},
+               exportName_{} {}
 
     std::string romPath_;
     int videoScale_;
+    Filter filter_; // How the screen is scaled to the window
+    ColourScheme colourScheme_;
     int cpuFrequency_;
     bool mute_;
     Mode mode_;
+    Quirks quirks_; // Enabled on top of the quirks of the mode
+    Engine engine_;
+    int runAhead_; // Frames shown ahead of the emulated machine
+    bool showTiming_;
+    bool audioSync_; // Pace emulation by the clock of the audio device instead of the system clock
+    std::string capturePath_; // Run without a window and capture the screen to this file instead, or stdout if "-"
+    CaptureFormat captureFormat_;
+    int captureFrames_;
+    bool captureSkipDuplicates_;
+    bool terminal_; // Draw in the terminal instead of a window
+    int terminalFrameRate_;
+    std::string exportName_; // Shared memory to export every frame to, if not empty
 };
@@ -4,6 +4,7 @@
 #include <charconv>
 #include <filesystem>
 #include <iostream>
+#include <sstream>
 
 Configurator::Configurator(int &argc, char **argv) {
     programName_ = std::filesystem::path(argv[0]).filename().string();
@@ -16,6 +17,43 @@ Configurator::Configurator(int &argc, char **argv) {
     modeMap_ = {{Mode::CHIP8,  "8"},
                 {Mode::CHIP48, "48"},
                 {Mode::SCHIP,  "S"},
+                {Mode::XOCHIP, "XO"},
+    };
+
+    // Set up map for mapping engine enums to strings
+    engineMap_ = {{Engine::TABLE,  "table"},
+                  {Engine::SWITCH, "switch"},
+                  {Engine::BLOCK,  "block"},
+                  {Engine::JIT,    "jit"},
+                  {Engine::AOT,    "aot"},
+    };
+
+    // Set up map for mapping quirk enums to strings
+    quirkMap_ = {{Quirk::SHIFT_VY,             "shift"},
+                 {Quirk::LOAD_STORE_INCREMENT, "loadstore"},
+                 {Quirk::VF_RESET,             "vfreset"},
+                 {Quirk::CLIP_SPRITES,         "clip"},
+                 {Quirk::JUMP_VX,              "jump"},
+    };
+
+    // Set up map for mapping capture format enums to strings
+    captureFormatMap_ = {{CaptureFormat::Y4M, "y4m"},
+                         {CaptureFormat::PPM, "ppm"},
+    };
+
+    // Set up map for mapping filter enums to strings
+    filterMap_ = {{Filter::NONE,      "none"},
+                  {Filter::NEAREST,   "nearest"},
+                  {Filter::SCALE2X,   "scale2x"},
+                  {Filter::SCALE3X,   "scale3x"},
+                  {Filter::SCANLINES, "scanlines"},
+    };
+
+    // Set up map for mapping colour scheme enums to strings
+    colourSchemeMap_ = {{ColourScheme::DEFAULT, "default"},
+                        {ColourScheme::AMBER,   "amber"},
+                        {ColourScheme::GREEN,   "green"},
+                        {ColourScheme::LCD,     "lcd"},
     };
 }
 
@@ -27,17 +65,73 @@ void Configurator::printUsage() {
               "Options:                                                                                            \n" \
               "   --scale <scale factor>  Set the scale factor of the window. The CHIP-8 screen is 64*32 pixels.   \n" \
               "                           Default: " + std::to_string(defaultConfig.videoScale_) + "\n" \
-              "   --cpufreq <frequency>   Set the CPU frequency of the emulator.                                   \n" \
+              "   --filter ( none | nearest | scale2x | scale3x | scanlines )                                      \n" \
+              "                           Choose how the screen is scaled to the window.                           \n" \
+              "                           none: stretched by the renderer, on the GPU if there is one.             \n" \
+              "                           nearest: scaled by whole numbers on the CPU, so that software renderers  \n" \
+              "                           only have to copy it. The screen is centred in the window.               \n" \
+              "                           scale2x: like nearest, but diagonal edges are rounded off first.         \n" \
+              "                           scale3x: the same at three times the size, for large windows.            \n" \
+              "                           scanlines: like nearest, with every other line at half brightness.       \n" \
+              "                           Default: " + filterToStr(defaultConfig.filter_) + "\n" \
+              "   --colours ( default | amber | green | lcd )                                                      \n" \
+              "                           Choose the colours of pixels which are on and off in the window.         \n" \
+              "                           Default: " + colourSchemeToStr(defaultConfig.colourScheme_) + "\n" \
+              "   --cpufreq <frequency>   Set the CPU frequency of the emulator. The delay and sound timers are    \n" \
+              "                           ticked every (frequency / 60) emulated instructions.                     \n" \
               "                           Default: " + std::to_string(defaultConfig.cpuFrequency_) + "\n" \
               "   --mute                  Mute the emulator.                                                       \n" \
               "                           Default: " << defaultConfig.mute_ << "\n" \
-              "   --mode ( 8 | 48 | S )   Choose the way opcodes 8XY6, 8XYE, FX55 and FX65 are executed.           \n" \
+              "   --mode ( 8 | 48 | S | XO )                                                                       \n" \
+              "                           Choose the way opcodes 8XY6, 8XYE, FX55 and FX65 are executed.           \n" \
               "                           8: execute like on the original CHIP-8. Most games won't work properly.  \n" \
               "                           but this can help very old games.                                        \n" \
               "                           48: execute like on the CHIP-48. Most games will work properly.          \n" \
-              "                           S: execute like on the SCHIP (without SCHIP opcode support). The majority\n" \
+              "                           S: execute like on the SCHIP. DXY0 draws 16x16 sprites. The majority     \n" \
               "                           of games assume that the FX55 and FX65 will work like on the SCHIP.      \n" \
+              "                           XO: execute like on the XO-CHIP, which has 64 KB of memory for ROMs.     \n" \
+              "                           FX55 and FX65 increment I, and DXY0 draws 16x16 sprites.                 \n" \
               "                           Default: " + modeToStr(defaultConfig.mode_) + "\n" \
+              "   --quirks <quirk,...>    Enable quirks on top of the ones of the mode. Comma separated list of:   \n" \
+              "                           shift: 8XY6 and 8XYE shift VY into VX. On in mode 8.                     \n" \
+              "                           loadstore: FX55 and FX65 increment I. On in modes 8, 48 and XO.          \n" \
+              "                           vfreset: 8XY1, 8XY2 and 8XY3 reset VF to 0.                              \n" \
+              "                           clip: DXYN clips sprites at the edges of the screen instead of wrapping. \n" \
+              "                           jump: BXNN jumps to XNN + VX instead of NNN + V0.                        \n" \
+              "                           Default: " + quirksToStr(defaultConfig.quirks_) + "\n" \
+              "   --engine ( table | switch | block | jit | aot )                                                  \n" \
+              "                           Choose how instructions are dispatched.                                  \n" \
+              "                           table: nested function tables. This is the reference implementation.     \n" \
+              "                           switch: a single switch over pre-decoded instructions. Faster.           \n" \
+              "                           block: cached blocks of instructions, with common instruction sequences  \n" \
+              "                           fused together. Fastest when instructions are run in batches.            \n" \
+              "                           jit: blocks compiled to x86-64 machine code. Only on x86-64 Linux.       \n" \
+              "                           aot: ROMs translated to C++ by chip8_aot and built into the emulator.    \n" \
+              "                           Default: " + engineToStr(defaultConfig.engine_) + "\n" \
+              "   --runahead <frames>     Show the screen this many frames ahead of the emulated machine, which    \n" \
+              "                           hides the frames it takes ROMs to react to input. Up to 4.               \n" \
+              "                           Default: " + std::to_string(defaultConfig.runAhead_) + "\n" \
+              "   --timing                Print how evenly frames were paced every second.                         \n" \
+              "   --audiosync             Pace emulation by the clock of the audio device instead of the system    \n" \
+              "                           clock, so sound never drifts or skips. Not available when muted.         \n" \
+              "   --capture <path>        Run without a window as fast as possible, and write every frame to the   \n" \
+              "                           file, or to stdout if the path is -. Frames are 128*64 pixels.           \n" \
+              "   --captureformat ( y4m | ppm )                                                                    \n" \
+              "                           y4m: a YUV4MPEG2 stream at 60 frames per second.                         \n" \
+              "                           ppm: binary PPM images one after another.                                \n" \
+              "                           Default: " + captureFormatToStr(defaultConfig.captureFormat_) + "\n" \
+              "   --captureframes <count> Stop capturing after this many frames.                                   \n" \
+              "                           Default: " + std::to_string(defaultConfig.captureFrames_) + "\n" \
+              "   --captureskip           Write runs of identical frames once, tagged with how many frames they    \n" \
+              "                           last, instead of writing every frame.                                    \n" \
+              "   --terminal              Draw the screen in the terminal instead of a window, and read the keypad \n" \
+              "                           from it. Needs a terminal at least 128 columns wide for SCHIP ROMs.      \n" \
+              "                           Sound is muted. Escape or Ctrl+C quits.                                  \n" \
+              "   --terminalfps <fps>     Update the terminal at most this many times per second.                  \n" \
+              "                           Default: " + std::to_string(defaultConfig.terminalFrameRate_) + "\n" \
+              "   --export <name>         Export every frame, with its number, changed rows and the keypad, to a   \n" \
+              "                           ring in POSIX shared memory of this name for other processes to read.    \n" \
+              "                           See tools/FrameReader.cpp for how to read it.                            \n" \
               "   -h, --help              Display this help dialogue.\n";
 }
 
@@ -62,6 +156,14 @@ void Configurator::configure(Config &config) {
         }
     }
 
+    if (std::string filterStr = getArgValue("--filter"); !filterStr.empty()) {
+        config.filter_ = strToFilter(filterStr, config.filter_);
+    }
+
+    if (std::string colourSchemeStr = getArgValue("--colours"); !colourSchemeStr.empty()) {
+        config.colourScheme_ = strToColourScheme(colourSchemeStr, config.colourScheme_);
+    }
+
     if (std::string cpuFreqStr = getArgValue("--cpufreq"); !cpuFreqStr.empty()) {
         auto result = std::from_chars(cpuFreqStr.data(), cpuFreqStr.data() + cpuFreqStr.size(),
                                       config.cpuFrequency_);
@@ -79,6 +181,79 @@ void Configurator::configure(Config &config) {
     if (std::string modeStr = getArgValue("--mode"); !modeStr.empty()) {
         config.mode_ = strToMode(modeStr, config.mode_);
     }
+
+    if (std::string quirksStr = getArgValue("--quirks"); !quirksStr.empty()) {
+        config.quirks_ = strToQuirks(quirksStr);
+    }
+
+    if (std::string engineStr = getArgValue("--engine"); !engineStr.empty()) {
+        config.engine_ = strToEngine(engineStr, config.engine_);
+    }
+
+    if (argExists("--timing")) {
+        config.showTiming_ = true;
+    }
+
+    if (std::string runAheadStr = getArgValue("--runahead"); !runAheadStr.empty()) {
+        int runAhead = 0;
+        auto result = std::from_chars(runAheadStr.data(), runAheadStr.data() + runAheadStr.size(), runAhead);
+
+        if (static_cast<bool>(result.ec) || runAhead < 0 || runAhead > MAX_RUN_AHEAD) {
+            std::cerr << "Run-ahead must be between 0 and " + std::to_string(MAX_RUN_AHEAD) +
+                         " frames, using the default instead: " + std::to_string(config.runAhead_);
+        } else {
+            config.runAhead_ = runAhead;
+        }
+    }
+
+    config.capturePath_ = getArgValue("--capture");
+
+    if (std::string formatStr = getArgValue("--captureformat"); !formatStr.empty()) {
+        config.captureFormat_ = strToCaptureFormat(formatStr, config.captureFormat_);
+    }
+
+    if (std::string framesStr = getArgValue("--captureframes"); !framesStr.empty()) {
+        int frames = 0;
+        auto result = std::from_chars(framesStr.data(), framesStr.data() + framesStr.size(), frames);
+
+        if (static_cast<bool>(result.ec) || frames < 1) {
+            std::cerr << "Couldn't convert given frame count to a positive int, using the default instead: " +
+                         std::to_string(config.captureFrames_);
+        } else {
+            config.captureFrames_ = frames;
+        }
+    }
+
+    if (argExists("--captureskip")) {
+        config.captureSkipDuplicates_ = true;
+    }
+
+    if (argExists("--terminal")) {
+        config.terminal_ = true;
+        config.mute_ = true;
+    }
+
+    if (std::string frameRateStr = getArgValue("--terminalfps"); !frameRateStr.empty()) {
+        int frameRate = 0;
+        auto result = std::from_chars(frameRateStr.data(), frameRateStr.data() + frameRateStr.size(), frameRate);
+
+        if (static_cast<bool>(result.ec) || frameRate < 1) {
+            std::cerr << "Couldn't convert given terminal frame rate to a positive int, using the default instead: " +
+                         std::to_string(config.terminalFrameRate_);
+        } else {
+            config.terminalFrameRate_ = frameRate;
+        }
+    }
+
+    config.exportName_ = getArgValue("--export");
+
+    if (argExists("--audiosync")) {
+        if (config.mute_) {
+            std::cerr << "Can't sync to the audio device while muted, using the system clock instead\n";
+        } else {
+            config.audioSync_ = true;
+        }
+    }
 }
 
 std::string Configurator::getArgValue(const std::string &option) const {
@@ -114,3 +289,114 @@ Mode Configurator::strToMode(const std::string &str, Mode defaultMode) {
     std::cerr << "Specified mode not found, using default instead: " + modeToStr(defaultMode);
     return defaultMode;
 }
+
+std::string Configurator::engineToStr(Engine engine) {
+    if (engineMap_.find(engine) != engineMap_.end()) {
+        return engineMap_[engine];
+    } else {
+        // This will only occur if the engineMap is not updated after a new engine is added
+        return "Unknown";
+    }
+}
+
+Engine Configurator::strToEngine(const std::string &str, Engine defaultEngine) {
+    for (const auto &it : engineMap_) {
+        if (it.second == str) {
+            return it.first;
+        }
+    }
+
+    std::cerr << "Specified engine not found, using default instead: " + engineToStr(defaultEngine);
+    return defaultEngine;
+}
+
+std::string Configurator::captureFormatToStr(CaptureFormat format) {
+    if (captureFormatMap_.find(format) != captureFormatMap_.end()) {
+        return captureFormatMap_[format];
+    } else {
+        // This will only occur if the captureFormatMap is not updated after a new format is added
+        return "Unknown";
+    }
+}
+
+CaptureFormat Configurator::strToCaptureFormat(const std::string &str, CaptureFormat defaultFormat) {
+    for (const auto &it : captureFormatMap_) {
+        if (it.second == str) {
+            return it.first;
+        }
+    }
+
+    std::cerr << "Specified capture format not found, using default instead: " + captureFormatToStr(defaultFormat);
+    return defaultFormat;
+}
+
+std::string Configurator::filterToStr(Filter filter) {
+    if (filterMap_.find(filter) != filterMap_.end()) {
+        return filterMap_[filter];
+    } else {
+        // This will only occur if the filterMap is not updated after a new filter is added
+        return "Unknown";
+    }
+}
+
+Filter Configurator::strToFilter(const std::string &str, Filter defaultFilter) {
+    for (const auto &it : filterMap_) {
+        if (it.second == str) {
+            return it.first;
+        }
+    }
+
+    std::cerr << "Specified filter not found, using default instead: " + filterToStr(defaultFilter);
+    return defaultFilter;
+}
+
+std::string Configurator::colourSchemeToStr(ColourScheme scheme) {
+    if (colourSchemeMap_.find(scheme) != colourSchemeMap_.end()) {
+        return colourSchemeMap_[scheme];
+    } else {
+        // This will only occur if the colourSchemeMap is not updated after a new scheme is added
+        return "Unknown";
+    }
+}
+
+ColourScheme Configurator::strToColourScheme(const std::string &str, ColourScheme defaultScheme) {
+    for (const auto &it : colourSchemeMap_) {
+        if (it.second == str) {
+            return it.first;
+        }
+    }
+
+    std::cerr << "Specified colours not found, using default instead: " + colourSchemeToStr(defaultScheme);
+    return defaultScheme;
+}
+
+std::string Configurator::quirksToStr(Quirks quirks) {
+    std::string str;
+
+    for (const auto &it : quirkMap_) {
+        if ((quirks & quirkBit(it.first)) != 0) {
+            str += (str.empty() ? "" : ",") + it.second;
+        }
+    }
+
+    return str.empty() ? "none" : str;
+}
+
+Quirks Configurator::strToQuirks(const std::string &str) {
+    Quirks quirks = 0;
+    std::istringstream ss{str};
+
+    for (std::string name; std::getline(ss, name, ',');) {
+        auto it = std::find_if(quirkMap_.begin(), quirkMap_.end(), [&name](const auto &quirk) {
+            return quirk.second == name;
+        });
+
+        if (it != quirkMap_.end()) {
+            quirks |= quirkBit(it->first);
+        } else {
+            std::cerr << "Specified quirk not found, ignoring it: " + name;
+        }
+    }
+
+    return quirks;
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "CaptureFormat.h"
+#include "ColourScheme.h"
 #include "Config.h"
+#include "Engine.h"
+#include "Filter.h"
 #include "Mode.h"
+#include "Quirks.h"
 
 #include <string>
 #include <unordered_map>
@@ -24,7 +29,32 @@ private:
 
     Mode strToMode(const std::string &str, Mode defaultMode);
 
+    std::string engineToStr(Engine engine);
+
+    Engine strToEngine(const std::string &str, Engine defaultEngine);
+
+    std::string quirksToStr(Quirks quirks);
+
+    std::string captureFormatToStr(CaptureFormat format);
+
+    CaptureFormat strToCaptureFormat(const std::string &str, CaptureFormat defaultFormat);
+
+    Quirks strToQuirks(const std::string &str);
+
+    std::string filterToStr(Filter filter);
+
+    Filter strToFilter(const std::string &str, Filter defaultFilter);
+
+    std::string colourSchemeToStr(ColourScheme scheme);
+
+    ColourScheme strToColourScheme(const std::string &str, ColourScheme defaultScheme);
+
     std::string programName_;
     std::vector<std::string> tokens_;
     std::unordered_map<Mode, std::string> modeMap_;
+    std::unordered_map<Engine, std::string> engineMap_;
+    std::unordered_map<Quirk, std::string> quirkMap_;
+    std::unordered_map<CaptureFormat, std::string> captureFormatMap_;
+    std::unordered_map<Filter, std::string> filterMap_;
+    std::unordered_map<ColourScheme, std::string> colourSchemeMap_;
 };
@@ -3,3 +3,4 @@
 const unsigned int KEY_COUNT = 16;
 const unsigned int VIDEO_WIDTH = 64;
 const unsigned int VIDEO_HEIGHT = 32;
+const unsigned int TIMER_FREQUENCY = 60;
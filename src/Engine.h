@@ -0,0 +1,14 @@
+#pragma once
+
+enum class Engine {
+    TABLE, // Reference engine, dispatches through nested tables of member function pointers
+    SWITCH, // Dispatches pre-decoded instructions through a single switch
+    // Executes cached blocks of pre-decoded instructions, with common instruction sequences fused together. Faster than
+    // the switch engine on long runs of arithmetic, but slower on key polling loops, whose blocks are an instruction
+    // or two long.
+    BLOCK,
+    // Executes blocks compiled to x86-64 machine code, falling back to the switch engine for other instructions. Faster
+    // than the switch engine on long runs of arithmetic, but slower on ROMs which mostly wait for a key with FX0A.
+    JIT,
+    AOT // Runs ROMs translated ahead of time by chip8_aot, falling back to the switch engine for other code
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "Chip8.h"
+
+// Quirks are checked through this, so that with a compile-time set of quirks, every check is resolved at compile time
+template <Quirks Q>
+inline bool Chip8::hasQuirk(Quirk quirk) const {
+    if constexpr (Q == RUNTIME_QUIRKS) {
+        return (quirks_ & quirkBit(quirk)) != 0;
+    } else {
+        return (Q & quirkBit(quirk)) != 0;
+    }
+}
+
+// Length of a taken skip. F000 NNNN is 4 bytes long, and is skipped as a whole.
+inline unsigned int Chip8::skipLength() const {
+    return memory_[(pc_ + 2) & (MEMORY_SIZE - 1)] == 0xF0 && memory_[(pc_ + 3) & (MEMORY_SIZE - 1)] == 0x00 ? 6 : 4;
+}
+
+// Only the low nibble of VX picks a key
+inline bool Chip8::keyPressed(unsigned int key) const {
+    return (keys_.load(std::memory_order_relaxed) >> (key & 0xF) & 1) != 0;
+}
+
+// The highest key wins when several are pressed, or -1 if none are
+inline int Chip8::highestPressedKey() const {
+    const unsigned int keys = keys_.load(std::memory_order_relaxed);
+    return keys == 0 ? -1 : 31 - __builtin_clz(keys);
+}
+
+// Picks the variant of drawSprite for the clipping quirk
+template <Quirks Q>
+inline void Chip8::drawSprite(unsigned int x, unsigned int y, unsigned int height) {
+    if (hasQuirk<Q>(Quirk::CLIP_SPRITES)) {
+        blitSprite<true>(x, y, height);
+    } else {
+        blitSprite<false>(x, y, height);
+    }
+}
+
+// Executes a pre-decoded instruction and returns the number of opcodes that were executed. The semantics of each case
+// mirror the opcodeXXXX function of the same name, so that all engines produce identical results.
+// Defined inline in a header so that it can be inlined into the dispatch loops of the engines, and into the code
+// generated by chip8_aot, where the constant instructions reduce each call to the code of a single case. Inlining is
+// forced, as the compiler stops inlining it once the engines are instantiated for every combination of quirks.
+template <Quirks Q>
+[[gnu::always_inline]] inline unsigned int Chip8::execute(const Instruction &instruction) {
+    const auto x = instruction.x;
+    const auto y = instruction.y;
+
+    switch (instruction.op) {
+        case Op::OPCODE_00E0:
+            clearScreen();
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_00EE:
+            sp_ = (sp_ - 1) & (STACK_SIZE - 1);
+            pc_ = stack_[sp_] + 2;
+            break;
+        case Op::OPCODE_00CN:
+            scrollDown(instruction.n);
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_00DN:
+            scrollUp(instruction.n);
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_00FB:
+            scrollRight(4);
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_00FC:
+            scrollLeft(4);
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_00FD:
+            break;
+        case Op::OPCODE_00FE:
+        case Op::OPCODE_00FF:
+            setHighResolution(instruction.op == Op::OPCODE_00FF);
+            drawFlag_ = true;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_1NNN:
+            pc_ = instruction.nnn;
+            break;
+        case Op::OPCODE_2NNN:
+            stack_[sp_] = pc_;
+            sp_ = (sp_ + 1) & (STACK_SIZE - 1);
+            pc_ = instruction.nnn;
+            break;
+        case Op::OPCODE_3XNN:
+            pc_ += registers_[x] == instruction.nn ? skipLength() : 2;
+            break;
+        case Op::OPCODE_4XNN:
+            pc_ += registers_[x] != instruction.nn ? skipLength() : 2;
+            break;
+        case Op::OPCODE_5XY0:
+            pc_ += registers_[x] == registers_[y] ? skipLength() : 2;
+            break;
+        case Op::OPCODE_5XY2:
+            storeRegisterRange(x, y);
+            pc_ += 2;
+            break;
+        case Op::OPCODE_5XY3:
+            loadRegisterRange(x, y);
+            pc_ += 2;
+            break;
+        case Op::OPCODE_6XNN:
+            registers_[x] = instruction.nn;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_7XNN:
+            registers_[x] += instruction.nn;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY0:
+            registers_[x] = registers_[y];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY1:
+            registers_[x] |= registers_[y];
+            if (hasQuirk<Q>(Quirk::VF_RESET)) {
+                registers_[0xF] = 0;
+            }
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY2:
+            registers_[x] &= registers_[y];
+            if (hasQuirk<Q>(Quirk::VF_RESET)) {
+                registers_[0xF] = 0;
+            }
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY3:
+            registers_[x] ^= registers_[y];
+            if (hasQuirk<Q>(Quirk::VF_RESET)) {
+                registers_[0xF] = 0;
+            }
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY4:
+            registers_[0xF] = registers_[x] + registers_[y] > 0xFFF ? 1 : 0;
+            registers_[x] += registers_[y];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY5:
+            registers_[0xF] = registers_[y] > registers_[x] ? 0 : 1;
+            registers_[x] -= registers_[y];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY6:
+            registers_[0xF] = registers_[x] & 0x1;
+            registers_[x] = (hasQuirk<Q>(Quirk::SHIFT_VY) ? registers_[y] : registers_[x]) >> 1;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XY7:
+            registers_[0xF] = registers_[x] > registers_[y] ? 0 : 1;
+            registers_[x] = registers_[y] - registers_[x];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_8XYE:
+            registers_[0xF] = registers_[x] >> 7;
+            registers_[x] = (hasQuirk<Q>(Quirk::SHIFT_VY) ? registers_[y] : registers_[x]) << 1;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_9XY0:
+            pc_ += registers_[x] != registers_[y] ? skipLength() : 2;
+            break;
+        case Op::OPCODE_ANNN:
+            index_ = instruction.nnn;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_BNNN:
+            pc_ = instruction.nnn + registers_[hasQuirk<Q>(Quirk::JUMP_VX) ? x : 0] + 2;
+            break;
+        case Op::OPCODE_CXNN:
+            registers_[x] = randByte_(randEngine_) & instruction.nn;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_DXYN:
+            drawSprite<Q>(x, y, instruction.n);
+            pc_ += 2;
+            break;
+        case Op::OPCODE_EX9E:
+            pc_ += keyPressed(registers_[x]) ? skipLength() : 2;
+            break;
+        case Op::OPCODE_EXA1:
+            pc_ += !keyPressed(registers_[x]) ? skipLength() : 2;
+            break;
+        case Op::OPCODE_F000:
+            index_ = memory_[(pc_ + 2) & (MEMORY_SIZE - 1)] << 8 | memory_[(pc_ + 3) & (MEMORY_SIZE - 1)];
+            pc_ += 4;
+            break;
+        case Op::OPCODE_FN01:
+            selectedPlanes_ = x;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_F002:
+            loadAudioPattern();
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX07:
+            registers_[x] = delayTimer_;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX0A:
+            if (const auto key = highestPressedKey(); key >= 0) {
+                registers_[x] = static_cast<uint8_t>(key);
+                pc_ += 2;
+            }
+            break;
+        case Op::OPCODE_FX15:
+            delayTimer_ = registers_[x];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX18:
+            soundTimer_ = registers_[x];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX1E:
+            registers_[0xF] = index_ + registers_[x] > 0xFFF ? 1 : 0;
+            index_ += registers_[x];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX29:
+            index_ = FONT_SET_START_ADDRESS + registers_[x] * CHARACTER_SPRITE_WIDTH;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX30:
+            index_ = BIG_FONT_SET_START_ADDRESS + registers_[x] * BIG_CHARACTER_SPRITE_WIDTH;
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX33:
+            storeBcd(x);
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX3A:
+            audioPattern_.pitch = registers_[x];
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX55:
+            storeRegisters(x);
+            if (hasQuirk<Q>(Quirk::LOAD_STORE_INCREMENT)) {
+                index_ += x + 1;
+            }
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX65:
+            loadRegisters(x);
+            if (hasQuirk<Q>(Quirk::LOAD_STORE_INCREMENT)) {
+                index_ += x + 1;
+            }
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX75:
+            storeRplFlags(x);
+            pc_ += 2;
+            break;
+        case Op::OPCODE_FX85:
+            loadRplFlags(x);
+            pc_ += 2;
+            break;
+        case Op::FUSED_3XNN_1NNN:
+            if (registers_[x] == instruction.nn) {
+                pc_ += 4;
+                return 1;
+            }
+            pc_ = instruction.nnn;
+            return 2;
+        case Op::FUSED_4XNN_1NNN:
+            if (registers_[x] != instruction.nn) {
+                pc_ += 4;
+                return 1;
+            }
+            pc_ = instruction.nnn;
+            return 2;
+        case Op::FUSED_EX9E_1NNN:
+            if (keyPressed(registers_[x])) {
+                pc_ += 4;
+                return 1;
+            }
+            pc_ = instruction.nnn;
+            return 2;
+        case Op::FUSED_EXA1_1NNN:
+            if (!keyPressed(registers_[x])) {
+                pc_ += 4;
+                return 1;
+            }
+            pc_ = instruction.nnn;
+            return 2;
+        case Op::FUSED_FX07_3XNN_1NNN:
+            registers_[x] = delayTimer_;
+            if (registers_[x] == instruction.nn) {
+                pc_ += 6;
+                return 2;
+            }
+            pc_ = instruction.nnn;
+            return 3;
+        case Op::FUSED_ANNN_DXYN:
+            index_ = instruction.nnn;
+            drawSprite<Q>(x, y, instruction.n);
+            pc_ += 4;
+            return 2;
+        case Op::UNKNOWN:
+        case Op::UNDECODED:
+            opcode_ = memory_[pc_] << 8 | memory_[(pc_ + 1) & (MEMORY_SIZE - 1)];
+            opcodeUnknown();
+            break;
+    }
+
+    return 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+enum class Filter {
+    NONE, // The screen is stretched over the window by the renderer, on the GPU if there is one
+    NEAREST, // Nearest neighbour scaling by a whole number on the CPU, which is all software renderers then have to copy
+    SCALE2X, // Scale2x, which rounds off diagonal edges, followed by nearest neighbour scaling
+    SCALE3X, // Scale3x, the same at three times the size
+    SCANLINES // Nearest neighbour scaling with every other line of the window at half brightness
+};
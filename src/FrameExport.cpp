@@ -0,0 +1,99 @@
+#include "FrameExport.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+
+FrameExport::FrameExport(const std::string &name)
+        : name_{name.empty() || name[0] != '/' ? "/" + name : name},
+          shared_{nullptr},
+          previous_{},
+          frameNumber_{0} {
+
+    const int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Can't open shared memory " + name_ + ". " + std::strerror(errno));
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(SharedFrames)) == 0) {
+        memory = mmap(nullptr, sizeof(SharedFrames), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int error = errno;
+    close(fd);
+
+    if (memory == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Can't map shared memory " + name_ + ". " + std::strerror(error));
+    }
+
+    // Left over shared memory of the same name is started over. Readers wait for the first frame before trusting the
+    // header.
+    std::memset(memory, 0, sizeof(SharedFrames));
+    shared_ = new(memory) SharedFrames{};
+    shared_->magic = SHARED_FRAMES_MAGIC;
+    shared_->version = SHARED_FRAMES_VERSION;
+    shared_->slotCount = SHARED_FRAME_SLOTS;
+    shared_->frameSize = sizeof(SharedFrame);
+}
+
+FrameExport::~FrameExport() {
+    munmap(shared_, sizeof(SharedFrames));
+    shm_unlink(name_.c_str());
+}
+
+void FrameExport::publish(const Video &video, uint16_t keys) {
+    uint64_t dirtyRows = 0;
+    if (frameNumber_ == 0 || video.width != previous_.width) {
+        dirtyRows = allRows(video.height);
+    } else {
+        for (unsigned int row = 0; row < video.height; row++) {
+            for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                if (video.planes[plane][row] != previous_.planes[plane][row]) {
+                    dirtyRows |= uint64_t{1} << row;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Readers which see the odd sequence, or see it change while they read, know the slot is being overwritten
+    auto &frame = shared_->frames[frameNumber_ % SHARED_FRAME_SLOTS];
+    frame.sequence.store(2 * frameNumber_ + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    frame.frameNumber = frameNumber_;
+    frame.dirtyRows = dirtyRows;
+    frame.keys = keys;
+    frame.width = static_cast<uint16_t>(video.width);
+    frame.height = static_cast<uint16_t>(video.height);
+    frame.planes = video.planes;
+
+    frame.sequence.store(2 * (frameNumber_ + 1), std::memory_order_release);
+    shared_->framesWritten.store(frameNumber_ + 1, std::memory_order_release);
+
+    previous_ = video;
+    frameNumber_++;
+}
+
+#else
+
+FrameExport::FrameExport(const std::string &name) : name_{name}, shared_{nullptr}, previous_{}, frameNumber_{0} {
+    throw std::runtime_error("Exporting frames to shared memory isn't supported on Windows");
+}
+
+FrameExport::~FrameExport() = default;
+
+void FrameExport::publish(const Video &, uint16_t) {
+}
+
+#endif
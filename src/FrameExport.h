@@ -0,0 +1,30 @@
+#pragma once
+
+#include "SharedFrames.h"
+#include "Video.h"
+
+#include <cstdint>
+#include <string>
+
+// Publishes every frame into a ring in POSIX shared memory, laid out as SharedFrames, for other processes to read. The
+// shared memory is removed again when the export is destroyed, but processes which still have it mapped keep it.
+class FrameExport {
+public:
+    // Names are like "/chip8". The leading slash is added if it's missing.
+    explicit FrameExport(const std::string &name);
+
+    ~FrameExport();
+
+    FrameExport(const FrameExport &) = delete;
+
+    FrameExport &operator=(const FrameExport &) = delete;
+
+    void publish(const Video &video, uint16_t keys);
+
+private:
+    std::string name_;
+    SharedFrames *shared_;
+
+    Video previous_; // Last frame published, to work out which rows changed
+    uint64_t frameNumber_;
+};
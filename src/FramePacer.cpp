@@ -0,0 +1,70 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Bounds of how much of the wait is spun
+static const std::chrono::microseconds MIN_SPIN_TIME{50};
+static const std::chrono::microseconds MAX_SPIN_TIME{4000};
+
+FramePacer::FramePacer(double frequency)
+        : interval_{std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / frequency))},
+          deadline_{clock::now() + interval_},
+          lastFrameStart_{clock::now()},
+          spinTime_{MAX_SPIN_TIME / 4},
+          frames_{0},
+          jitterSumMs_{0},
+          maxJitterMs_{0},
+          busyTime_{0},
+          totalTime_{0} {
+}
+
+void FramePacer::waitForNextFrame() {
+    const auto waitStart = clock::now();
+    busyTime_ += waitStart - lastFrameStart_;
+
+    if (const auto sleepUntil = deadline_ - spinTime_; sleepUntil > waitStart) {
+        std::this_thread::sleep_until(sleepUntil);
+
+        // Jump up to a longer overshoot straight away, but only come down slowly
+        const auto overshoot = clock::now() - sleepUntil;
+        spinTime_ = overshoot > spinTime_ ? overshoot : spinTime_ - (spinTime_ - overshoot) / 64;
+        spinTime_ = std::clamp<clock::duration>(spinTime_, MIN_SPIN_TIME, MAX_SPIN_TIME);
+    }
+    while (clock::now() < deadline_) {
+    }
+
+    const auto frameStart = clock::now();
+    const std::chrono::duration<double, std::milli> frameTime = frameStart - lastFrameStart_;
+    const std::chrono::duration<double, std::milli> interval = interval_;
+    const auto jitter = std::abs(frameTime.count() - interval.count());
+    frames_++;
+    jitterSumMs_ += jitter;
+    maxJitterMs_ = std::max(maxJitterMs_, jitter);
+    totalTime_ += frameStart - lastFrameStart_;
+    lastFrameStart_ = frameStart;
+
+    // After falling more than a frame behind, e.g. when the window was being dragged, start again from now instead of
+    // rushing through the missed frames
+    deadline_ += interval_;
+    if (frameStart - deadline_ > interval_) {
+        deadline_ = frameStart + interval_;
+    }
+}
+
+FramePacer::Stats FramePacer::takeStats() {
+    Stats stats{frames_,
+                frames_ > 0 ? jitterSumMs_ / frames_ : 0,
+                maxJitterMs_,
+                totalTime_.count() > 0 ? 100.0 * static_cast<double>(busyTime_.count()) /
+                                         static_cast<double>(totalTime_.count()) : 0};
+
+    frames_ = 0;
+    jitterSumMs_ = 0;
+    maxJitterMs_ = 0;
+    busyTime_ = clock::duration{0};
+    totalTime_ = clock::duration{0};
+
+    return stats;
+}
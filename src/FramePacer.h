@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+
+// Paces a loop to a fixed frame rate. Frames are due at fixed intervals from the first one, so that waking up late
+// doesn't push back the frames after it.
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Frame times over the frames since the last call to takeStats
+    struct Stats {
+        unsigned int frames;
+        double meanJitterMs; // How far apart frames started, compared to the frame interval
+        double maxJitterMs;
+        double busyPercent; // Time spent between waits, out of the time frames took
+    };
+
+    explicit FramePacer(double frequency);
+
+    // Sleeps until the next frame is due. Sleeps tend to overshoot, so they're cut short by about as much as they have
+    // been overshooting lately, and the rest of the wait is spun.
+    void waitForNextFrame();
+
+    Stats takeStats();
+
+private:
+    const clock::duration interval_;
+    clock::time_point deadline_;
+    clock::time_point lastFrameStart_;
+    clock::duration spinTime_;
+
+    unsigned int frames_;
+    double jitterSumMs_;
+    double maxJitterMs_;
+    clock::duration busyTime_;
+    clock::duration totalTime_;
+};
@@ -0,0 +1,203 @@
+#include "Instruction.h"
+
+#include <memory>
+
+Instruction decode(uint16_t opcode) {
+    Instruction instruction{Op::UNKNOWN,
+                            static_cast<uint8_t>((opcode & 0x0F00) >> 8),
+                            static_cast<uint8_t>((opcode & 0x00F0) >> 4),
+                            static_cast<uint8_t>(opcode & 0x000F),
+                            static_cast<uint8_t>(opcode & 0x00FF),
+                            static_cast<uint16_t>(opcode & 0x0FFF)};
+
+    // Opcodes are matched on the same bits as the function tables in Chip8, so both engines agree on every opcode
+    switch ((opcode & 0xF000) >> 12) {
+        case 0x0:
+            switch (instruction.nn) {
+                case 0xFB:
+                    instruction.op = Op::OPCODE_00FB;
+                    break;
+                case 0xFC:
+                    instruction.op = Op::OPCODE_00FC;
+                    break;
+                case 0xFD:
+                    instruction.op = Op::OPCODE_00FD;
+                    break;
+                case 0xFE:
+                    instruction.op = Op::OPCODE_00FE;
+                    break;
+                case 0xFF:
+                    instruction.op = Op::OPCODE_00FF;
+                    break;
+                default:
+                    // Other opcodes are still matched on the low nibble alone, as ROMs rely on e.g. 0000 clearing the
+                    // screen
+                    if ((instruction.nn & 0xF0) == 0xC0) {
+                        instruction.op = Op::OPCODE_00CN;
+                    } else if ((instruction.nn & 0xF0) == 0xD0) {
+                        instruction.op = Op::OPCODE_00DN;
+                    } else if (instruction.n == 0x0) {
+                        instruction.op = Op::OPCODE_00E0;
+                    } else if (instruction.n == 0xE) {
+                        instruction.op = Op::OPCODE_00EE;
+                    }
+                    break;
+            }
+            break;
+        case 0x1:
+            instruction.op = Op::OPCODE_1NNN;
+            break;
+        case 0x2:
+            instruction.op = Op::OPCODE_2NNN;
+            break;
+        case 0x3:
+            instruction.op = Op::OPCODE_3XNN;
+            break;
+        case 0x4:
+            instruction.op = Op::OPCODE_4XNN;
+            break;
+        case 0x5:
+            switch (instruction.n) {
+                case 0x2:
+                    instruction.op = Op::OPCODE_5XY2;
+                    break;
+                case 0x3:
+                    instruction.op = Op::OPCODE_5XY3;
+                    break;
+                default:
+                    // 5XY0 has always been matched on the high nibble alone
+                    instruction.op = Op::OPCODE_5XY0;
+                    break;
+            }
+            break;
+        case 0x6:
+            instruction.op = Op::OPCODE_6XNN;
+            break;
+        case 0x7:
+            instruction.op = Op::OPCODE_7XNN;
+            break;
+        case 0x8:
+            switch (instruction.n) {
+                case 0x0:
+                    instruction.op = Op::OPCODE_8XY0;
+                    break;
+                case 0x1:
+                    instruction.op = Op::OPCODE_8XY1;
+                    break;
+                case 0x2:
+                    instruction.op = Op::OPCODE_8XY2;
+                    break;
+                case 0x3:
+                    instruction.op = Op::OPCODE_8XY3;
+                    break;
+                case 0x4:
+                    instruction.op = Op::OPCODE_8XY4;
+                    break;
+                case 0x5:
+                    instruction.op = Op::OPCODE_8XY5;
+                    break;
+                case 0x6:
+                    instruction.op = Op::OPCODE_8XY6;
+                    break;
+                case 0x7:
+                    instruction.op = Op::OPCODE_8XY7;
+                    break;
+                case 0xE:
+                    instruction.op = Op::OPCODE_8XYE;
+                    break;
+            }
+            break;
+        case 0x9:
+            instruction.op = Op::OPCODE_9XY0;
+            break;
+        case 0xA:
+            instruction.op = Op::OPCODE_ANNN;
+            break;
+        case 0xB:
+            instruction.op = Op::OPCODE_BNNN;
+            break;
+        case 0xC:
+            instruction.op = Op::OPCODE_CXNN;
+            break;
+        case 0xD:
+            instruction.op = Op::OPCODE_DXYN;
+            break;
+        case 0xE:
+            switch (instruction.n) {
+                case 0x1:
+                    instruction.op = Op::OPCODE_EXA1;
+                    break;
+                case 0xE:
+                    instruction.op = Op::OPCODE_EX9E;
+                    break;
+            }
+            break;
+        case 0xF:
+            switch (instruction.nn) {
+                case 0x00:
+                    instruction.op = Op::OPCODE_F000;
+                    break;
+                case 0x01:
+                    instruction.op = Op::OPCODE_FN01;
+                    break;
+                case 0x02:
+                    instruction.op = Op::OPCODE_F002;
+                    break;
+                case 0x07:
+                    instruction.op = Op::OPCODE_FX07;
+                    break;
+                case 0x0A:
+                    instruction.op = Op::OPCODE_FX0A;
+                    break;
+                case 0x15:
+                    instruction.op = Op::OPCODE_FX15;
+                    break;
+                case 0x18:
+                    instruction.op = Op::OPCODE_FX18;
+                    break;
+                case 0x1E:
+                    instruction.op = Op::OPCODE_FX1E;
+                    break;
+                case 0x29:
+                    instruction.op = Op::OPCODE_FX29;
+                    break;
+                case 0x30:
+                    instruction.op = Op::OPCODE_FX30;
+                    break;
+                case 0x33:
+                    instruction.op = Op::OPCODE_FX33;
+                    break;
+                case 0x3A:
+                    instruction.op = Op::OPCODE_FX3A;
+                    break;
+                case 0x55:
+                    instruction.op = Op::OPCODE_FX55;
+                    break;
+                case 0x65:
+                    instruction.op = Op::OPCODE_FX65;
+                    break;
+                case 0x75:
+                    instruction.op = Op::OPCODE_FX75;
+                    break;
+                case 0x85:
+                    instruction.op = Op::OPCODE_FX85;
+                    break;
+            }
+            break;
+    }
+
+    return instruction;
+}
+
+const std::array<Instruction, OPCODE_COUNT> &decodeTable() {
+    // Allocated on the heap as the table is 512 KB, which is too big for the stack while it's being built
+    static const auto table = [] {
+        auto decoded = std::make_unique<std::array<Instruction, OPCODE_COUNT>>();
+        for (unsigned int opcode = 0; opcode < OPCODE_COUNT; opcode++) {
+            (*decoded)[opcode] = decode(opcode);
+        }
+        return decoded;
+    }();
+
+    return *table;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+const unsigned int OPCODE_COUNT = 0x10000;
+
+// Opcodes are named after the same patterns as the opcodeXXXX functions in Chip8
+enum class Op : uint8_t {
+    UNDECODED, // Marks an empty slot in the instruction cache. Never returned by decode().
+    UNKNOWN,
+    OPCODE_00E0,
+    OPCODE_00EE,
+    OPCODE_00CN,
+    OPCODE_00DN,
+    OPCODE_00FB,
+    OPCODE_00FC,
+    OPCODE_00FD,
+    OPCODE_00FE,
+    OPCODE_00FF,
+    OPCODE_1NNN,
+    OPCODE_2NNN,
+    OPCODE_3XNN,
+    OPCODE_4XNN,
+    OPCODE_5XY0,
+    OPCODE_5XY2,
+    OPCODE_5XY3,
+    OPCODE_6XNN,
+    OPCODE_7XNN,
+    OPCODE_8XY0,
+    OPCODE_8XY1,
+    OPCODE_8XY2,
+    OPCODE_8XY3,
+    OPCODE_8XY4,
+    OPCODE_8XY5,
+    OPCODE_8XY6,
+    OPCODE_8XY7,
+    OPCODE_8XYE,
+    OPCODE_9XY0,
+    OPCODE_ANNN,
+    OPCODE_BNNN,
+    OPCODE_CXNN,
+    OPCODE_DXYN,
+    OPCODE_EX9E,
+    OPCODE_EXA1,
+    OPCODE_F000, // Followed by a second word with the address, which is read when it's executed
+    OPCODE_FN01,
+    OPCODE_F002,
+    OPCODE_FX07,
+    OPCODE_FX0A,
+    OPCODE_FX15,
+    OPCODE_FX18,
+    OPCODE_FX1E,
+    OPCODE_FX29,
+    OPCODE_FX33,
+    OPCODE_FX3A,
+    OPCODE_FX55,
+    OPCODE_FX65,
+    OPCODE_FX30,
+    OPCODE_FX75,
+    OPCODE_FX85,
+
+    // Superinstructions which replace common sequences of opcodes. Only produced when building blocks.
+    FUSED_3XNN_1NNN, // Skip if VX equals NN, otherwise jump. Uses x and nn of the skip and nnn of the jump.
+    FUSED_4XNN_1NNN, // Skip if VX doesn't equal NN, otherwise jump. Operands as above.
+    FUSED_EX9E_1NNN, // Skip if the key in VX is pressed, otherwise jump. Key polling loop. Operands as above.
+    FUSED_EXA1_1NNN, // Skip if the key in VX isn't pressed, otherwise jump. Operands as above.
+    FUSED_FX07_3XNN_1NNN, // Delay timer polling loop. Operands as above.
+    FUSED_ANNN_DXYN // Set I and draw a sprite. Uses nnn of ANNN and x, y and n of DXYN.
+};
+
+// An opcode with its operands already extracted, so that they don't need to be masked out on every execution
+struct Instruction {
+    Op op;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint16_t nnn;
+};
+
+// Most opcodes an instruction executes. Superinstructions which branch may execute fewer.
+inline unsigned int opcodeCount(const Instruction &instruction) {
+    switch (instruction.op) {
+        case Op::FUSED_FX07_3XNN_1NNN:
+            return 3;
+        case Op::FUSED_3XNN_1NNN:
+        case Op::FUSED_4XNN_1NNN:
+        case Op::FUSED_EX9E_1NNN:
+        case Op::FUSED_EXA1_1NNN:
+        case Op::FUSED_ANNN_DXYN:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// A straight run of instructions which ends at the first branch, so that it's always entered at its start. The
+// instructions themselves are stored one after another in a single buffer, so a block only records where they are.
+struct Block {
+    uint32_t first; // Position of the first instruction in the buffer
+    uint16_t size; // Number of instructions
+    uint16_t length; // Number of opcodes, counting each opcode in a superinstruction. 0 if the block isn't built.
+};
+
+Instruction decode(uint16_t opcode);
+
+// Decoded form of every possible opcode. Built once on first use.
+const std::array<Instruction, OPCODE_COUNT> &decodeTable();
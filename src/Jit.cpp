@@ -0,0 +1,674 @@
+#include "Jit.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#endif
+
+const std::size_t CODE_SIZE = 4 * 1024 * 1024;
+const unsigned int MAX_JIT_BLOCK_LENGTH = 32; // Same as the block engine
+const std::size_t MAX_BLOCK_CODE_SIZE = 8192; // Longest code emitted for a block, with all its exits, rounded up
+
+// Most bytes a block is translated from: its opcodes, and the opcode after a skip
+const unsigned int MAX_BLOCK_EXTENT = MAX_JIT_BLOCK_LENGTH * 2 + 2;
+
+// Host registers. Compiled blocks get V0 in rdi, I in rsi, the most opcodes they may run in edx, which is kept until
+// the block exits, and the pressed keys in ecx, which are pushed if the block needs them. eax and ecx are scratch
+// registers.
+const unsigned int RAX = 0;
+const unsigned int RCX = 1;
+[[maybe_unused]] const unsigned int RDX = 2; // Only used where blocks are compiled
+const unsigned int RBX = 3;
+const unsigned int RBP = 5;
+const unsigned int RSI = 6;
+const unsigned int RDI = 7;
+const unsigned int R8 = 8;
+const unsigned int R9 = 9;
+const unsigned int R10 = 10;
+const unsigned int R11 = 11;
+const unsigned int R12 = 12;
+const unsigned int R13 = 13;
+const unsigned int R14 = 14;
+const unsigned int R15 = 15;
+
+// Registers which V registers and I are kept in, in the order they're handed out. The ones after r11 are callee-saved,
+// so they're pushed on entry and popped at every exit.
+const std::array<unsigned int, 10> HOST_REGISTERS{R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15};
+
+const uint8_t VF = 0xF;
+
+// Condition codes of cmovcc, which the skips exit with
+const uint8_t CONDITION_CARRY = 0x2;
+const uint8_t CONDITION_NOT_CARRY = 0x3;
+const uint8_t CONDITION_EQUAL = 0x4;
+const uint8_t CONDITION_NOT_EQUAL = 0x5;
+
+const Jit::Block Jit::INTERPRETED{nullptr, 0, 0, false};
+
+// Prefix which selects the upper 8 registers. It's emitted even when it's 0x40, so that byte operations on rbp mean
+// bpl rather than ch.
+static uint8_t rex(unsigned int reg, unsigned int rm) {
+    return static_cast<uint8_t>(0x40 | (reg >> 3) << 2 | rm >> 3);
+}
+
+static uint8_t modrm(unsigned int mod, unsigned int reg, unsigned int rm) {
+    return static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (rm & 7));
+}
+
+static bool calleeSaved(unsigned int reg) {
+    return reg == RBX || reg == RBP || reg >= R12;
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+const unsigned int MIN_JIT_BLOCK_LENGTH = 2;
+
+static bool skips(Op op) {
+    return op == Op::OPCODE_3XNN || op == Op::OPCODE_4XNN || op == Op::OPCODE_5XY0 || op == Op::OPCODE_9XY0 ||
+           op == Op::OPCODE_EX9E || op == Op::OPCODE_EXA1;
+}
+
+// Calls, returns, timers, FX0A, drawing, random numbers and memory accesses are left to the interpreter
+static bool translatable(Op op) {
+    switch (op) {
+        case Op::OPCODE_1NNN:
+        case Op::OPCODE_3XNN:
+        case Op::OPCODE_4XNN:
+        case Op::OPCODE_5XY0:
+        case Op::OPCODE_9XY0:
+        case Op::OPCODE_EX9E:
+        case Op::OPCODE_EXA1:
+        case Op::OPCODE_6XNN:
+        case Op::OPCODE_7XNN:
+        case Op::OPCODE_8XY0:
+        case Op::OPCODE_8XY1:
+        case Op::OPCODE_8XY2:
+        case Op::OPCODE_8XY3:
+        case Op::OPCODE_8XY4:
+        case Op::OPCODE_8XY5:
+        case Op::OPCODE_8XY6:
+        case Op::OPCODE_8XY7:
+        case Op::OPCODE_8XYE:
+        case Op::OPCODE_ANNN:
+        case Op::OPCODE_FX1E:
+        case Op::OPCODE_FX29:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#endif
+
+Jit::Jit(Quirks quirks, std::size_t memorySize)
+        : quirks_{quirks},
+          memorySize_{memorySize},
+          code_{nullptr},
+          executableCode_{nullptr},
+          codeSize_{CODE_SIZE},
+          codeEnd_{0},
+          blocks_(memorySize),
+          hits_(memorySize),
+          compiledCode_(memorySize),
+          hostRegisters_{},
+          written_{0} {
+#if defined(__x86_64__) && defined(__linux__)
+    const int fd = memfd_create("chip8-jit", 0);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(codeSize_)) != 0) {
+        const auto error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to create memory for the JIT: " + std::string(std::strerror(error)));
+    }
+
+    void *code = mmap(nullptr, codeSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void *executableCode = mmap(nullptr, codeSize_, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    const auto error = errno;
+    close(fd);
+    if (code == MAP_FAILED || executableCode == MAP_FAILED) {
+        if (code != MAP_FAILED) {
+            munmap(code, codeSize_);
+        }
+        if (executableCode != MAP_FAILED) {
+            munmap(executableCode, codeSize_);
+        }
+        throw std::runtime_error("Failed to map memory for the JIT: " + std::string(std::strerror(error)));
+    }
+    code_ = static_cast<uint8_t *>(code);
+    executableCode_ = static_cast<uint8_t *>(executableCode);
+#else
+    throw std::runtime_error("The JIT engine is only supported on x86-64 Linux");
+#endif
+}
+
+Jit::~Jit() {
+#if defined(__x86_64__) && defined(__linux__)
+    munmap(code_, codeSize_);
+    munmap(executableCode_, codeSize_);
+#endif
+}
+
+const Jit::Block &Jit::compileBlock(const uint8_t *memory, unsigned int address) {
+    // Throw away everything once the code buffer is full. Blocks are only looked up between executions, so none of
+    // them can be running at this point.
+    if (codeEnd_ + MAX_BLOCK_CODE_SIZE > codeSize_) {
+        flush();
+    }
+
+    blocks_[address] = compile(memory, address);
+    return blocks_[address];
+}
+
+void Jit::flush() {
+    blocks_.assign(memorySize_, {});
+    hits_.assign(memorySize_, 0);
+    compiledCode_.assign(memorySize_, false);
+    codeEnd_ = 0;
+}
+
+void Jit::invalidate(unsigned int address) {
+    if (address >= memorySize_ || !compiledCode_[address]) {
+        return;
+    }
+
+    // The code of dropped blocks stays in the buffer until it's flushed
+    const auto firstStart = address >= MAX_BLOCK_EXTENT ? address - MAX_BLOCK_EXTENT + 1 : 0;
+    for (auto start = firstStart; start <= address; start++) {
+        if (blocks_[start].compiled && start + blocks_[start].extent > address) {
+            blocks_[start] = {};
+            hits_[start] = 0;
+        }
+    }
+    compiledCode_[address] = false;
+}
+
+// Finds the instructions of the block first, so that the registers they use most can be kept in host registers. Every
+// exit stores the registers written so far back, and pops what the entry pushed.
+Jit::Block Jit::compile(const uint8_t *memory, unsigned int address) {
+    Block compiled{nullptr, 0, 0, true};
+
+#if defined(__x86_64__) && defined(__linux__)
+    const auto first = address;
+    std::vector<Instruction> instructions;
+    std::vector<unsigned int> addresses;
+    bool endOfBlock = false;
+    bool endsWithSkip = false;
+
+    while (!endOfBlock && instructions.size() < MAX_JIT_BLOCK_LENGTH && address + 1 < memorySize_) {
+        const auto &instruction = decodeTable()[memory[address] << 8 | memory[address + 1]];
+        const bool skip = skips(instruction.op);
+
+        // Skips jump over the whole of F000 NNNN, which is left to the interpreter
+        if (skip && (address + 3 >= memorySize_ || (memory[address + 2] == 0xF0 && memory[address + 3] == 0x00))) {
+            break;
+        }
+        if (!translatable(instruction.op)) {
+            break;
+        }
+
+        instructions.push_back(instruction);
+        addresses.push_back(address);
+
+        // Branches emit their own exit
+        if (instruction.op == Op::OPCODE_1NNN || skip) {
+            endOfBlock = true;
+            endsWithSkip = skip;
+        } else {
+            address += 2;
+        }
+    }
+
+    if (instructions.size() < MIN_JIT_BLOCK_LENGTH) {
+        // Entering and leaving compiled code costs more than interpreting a couple of instructions, so these are left
+        // to the interpreter until they're overwritten, which may make the block longer
+        compiled.extent = static_cast<uint8_t>(instructions.size() * 2 + 2);
+    } else {
+        const auto start = codeEnd_;
+        allocate(instructions);
+        emitPrologue();
+
+        // Blocks stop before any instruction they have no opcodes left for. Those exits are emitted after the block.
+        struct Stop {
+            std::size_t jump;
+            unsigned int length;
+            unsigned int address;
+            SlotMask written;
+        };
+        std::vector<Stop> stops;
+
+        for (std::size_t i = 0; i < instructions.size(); i++) {
+            const auto length = static_cast<unsigned int>(i);
+            if (i > 0) {
+                emit({0x83, modrm(3, 7, RDX), static_cast<uint8_t>(length + 1)}); // cmp edx, length + 1
+                emit({0x0F, 0x82}); // jb stop
+                stops.push_back({codeEnd_, length, addresses[i], written_});
+                emit32(0);
+            }
+            translate(instructions[i], addresses[i], length + 1);
+        }
+
+        compiled.length = static_cast<uint16_t>(instructions.size());
+        if (!endOfBlock) {
+            // Hand back to the interpreter at the instruction which stopped the translation
+            emitExit(compiled.length, address);
+        }
+
+        // Stops which store the same registers share the code after setting the return value
+        std::vector<std::pair<SlotMask, std::size_t>> epilogues;
+        for (const auto &stop : stops) {
+            patch32(stop.jump, static_cast<uint32_t>(codeEnd_ - (stop.jump + 4)));
+            emit({0xB8}); // mov eax, length << 16 | address
+            emit32(stop.length << 16 | (stop.address & 0xFFFF));
+
+            const auto shared = std::find_if(epilogues.begin(), epilogues.end(), [&stop](const auto &epilogue) {
+                return epilogue.first == stop.written;
+            });
+            if (shared != epilogues.end()) {
+                emit({0xE9}); // jmp epilogue
+                emit32(static_cast<uint32_t>(shared->second - (codeEnd_ + 4)));
+            } else {
+                epilogues.emplace_back(stop.written, codeEnd_);
+                emitEpilogue(stop.written);
+            }
+        }
+
+        compiled.function = reinterpret_cast<Function>(executableCode_ + start);
+
+        // A skip also depends on the next opcode, in case it's overwritten with F000
+        compiled.extent = static_cast<uint8_t>(compiled.length * 2u + (endsWithSkip ? 2 : 0));
+    }
+
+    for (auto i = first; i < first + compiled.extent && i < memorySize_; i++) {
+        compiledCode_[i] = true;
+    }
+#else
+    (void) memory;
+    (void) address;
+#endif
+
+    return compiled;
+}
+
+// Keeps the registers the block uses most in host registers, and the rest in memory
+void Jit::allocate(const std::vector<Instruction> &instructions) {
+    std::array<unsigned int, SLOT_COUNT> uses{};
+    const bool vfReset = (quirks_ & quirkBit(Quirk::VF_RESET)) != 0;
+    const bool shiftVy = (quirks_ & quirkBit(Quirk::SHIFT_VY)) != 0;
+
+    for (const auto &instruction : instructions) {
+        switch (instruction.op) {
+            case Op::OPCODE_3XNN:
+            case Op::OPCODE_4XNN:
+            case Op::OPCODE_EX9E:
+            case Op::OPCODE_EXA1:
+            case Op::OPCODE_6XNN:
+            case Op::OPCODE_7XNN:
+                uses[instruction.x]++;
+                break;
+            case Op::OPCODE_5XY0:
+            case Op::OPCODE_9XY0:
+            case Op::OPCODE_8XY0:
+                uses[instruction.x]++;
+                uses[instruction.y]++;
+                break;
+            case Op::OPCODE_8XY1:
+            case Op::OPCODE_8XY2:
+            case Op::OPCODE_8XY3:
+                uses[instruction.x]++;
+                uses[instruction.y]++;
+                uses[VF] += vfReset ? 1 : 0;
+                break;
+            case Op::OPCODE_8XY6:
+            case Op::OPCODE_8XYE:
+                uses[instruction.x]++;
+                uses[shiftVy ? instruction.y : instruction.x]++;
+                uses[VF]++;
+                break;
+            case Op::OPCODE_8XY4:
+            case Op::OPCODE_8XY5:
+            case Op::OPCODE_8XY7:
+                uses[instruction.x]++;
+                uses[instruction.y]++;
+                uses[VF]++;
+                break;
+            case Op::OPCODE_ANNN:
+                uses[INDEX_SLOT]++;
+                break;
+            case Op::OPCODE_FX1E:
+                uses[instruction.x]++;
+                uses[VF]++;
+                uses[INDEX_SLOT]++;
+                break;
+            case Op::OPCODE_FX29:
+                uses[instruction.x]++;
+                uses[INDEX_SLOT]++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::array<unsigned int, SLOT_COUNT> slots{};
+    std::iota(slots.begin(), slots.end(), 0);
+    std::stable_sort(slots.begin(), slots.end(), [&uses](unsigned int a, unsigned int b) {
+        return uses[a] > uses[b];
+    });
+
+    hostRegisters_.fill(-1);
+    savedRegisters_.clear();
+    written_ = 0;
+
+    // Key skips can only end a block
+    const auto last = instructions.back().op;
+    if (last == Op::OPCODE_EX9E || last == Op::OPCODE_EXA1) {
+        savedRegisters_.push_back(RCX);
+    }
+
+    // A register used only once is cheaper to leave in memory than to load on entry and store at the exits
+    for (std::size_t i = 0; i < HOST_REGISTER_COUNT && uses[slots[i]] > 1; i++) {
+        hostRegisters_[slots[i]] = static_cast<int>(HOST_REGISTERS[i]);
+        if (calleeSaved(HOST_REGISTERS[i])) {
+            savedRegisters_.push_back(HOST_REGISTERS[i]);
+        }
+    }
+}
+
+// Emits the machine code for a single instruction. length is the number of opcodes executed once this instruction
+// has finished, which branches need for their exit. The semantics match Chip8::execute.
+bool Jit::translate(const Instruction &instruction, unsigned int address, unsigned int length) {
+    const uint8_t x = instruction.x;
+    const uint8_t y = instruction.y;
+    const uint8_t shiftSource = (quirks_ & quirkBit(Quirk::SHIFT_VY)) != 0 ? y : x;
+    const bool vfReset = (quirks_ & quirkBit(Quirk::VF_RESET)) != 0;
+    const SlotMask writesX = 1u << x;
+    const SlotMask writesVf = 1u << VF;
+    const SlotMask writesIndex = 1u << INDEX_SLOT;
+
+    // Byte operations with V[x] as their first operand take the opcode of their r/m8, r8 form, and with V[x] as their
+    // second operand, the opcode of their r8, r/m8 form
+    switch (instruction.op) {
+        case Op::OPCODE_1NNN:
+            emitExit(length, instruction.nnn);
+            return true;
+        case Op::OPCODE_3XNN:
+            emitRegisterImmediate(0x80, 7, x, instruction.nn); // cmp V[x], nn
+            emitConditionalExit(length, address, CONDITION_EQUAL);
+            return true;
+        case Op::OPCODE_4XNN:
+            emitRegisterImmediate(0x80, 7, x, instruction.nn); // cmp V[x], nn
+            emitConditionalExit(length, address, CONDITION_NOT_EQUAL);
+            return true;
+        case Op::OPCODE_5XY0:
+            emitRegisterOp(0x8A, RAX, x); // mov al, V[x]
+            emitRegisterOp(0x3A, RAX, y); // cmp al, V[y]
+            emitConditionalExit(length, address, CONDITION_EQUAL);
+            return true;
+        case Op::OPCODE_9XY0:
+            emitRegisterOp(0x8A, RAX, x); // mov al, V[x]
+            emitRegisterOp(0x3A, RAX, y); // cmp al, V[y]
+            emitConditionalExit(length, address, CONDITION_NOT_EQUAL);
+            return true;
+        case Op::OPCODE_EX9E:
+        case Op::OPCODE_EXA1:
+            // The keys were pushed first, so they're below the other saved registers
+            emit({0x8B, 0x44, 0x24, static_cast<uint8_t>(8 * (savedRegisters_.size() - 1))}); // mov eax, [rsp + n]
+            emitLoadRegister(RCX, x); // ecx = V[x]
+            emit({0x83, 0xE1, 0x0F}); // and ecx, 0xF
+            emit({0x0F, 0xA3, 0xC8}); // bt eax, ecx
+            emitConditionalExit(length, address,
+                                instruction.op == Op::OPCODE_EX9E ? CONDITION_CARRY : CONDITION_NOT_CARRY);
+            return true;
+        case Op::OPCODE_6XNN:
+            emitRegisterImmediate(0xC6, 0, x, instruction.nn); // mov V[x], nn
+            written_ |= writesX;
+            return true;
+        case Op::OPCODE_7XNN:
+            emitRegisterImmediate(0x80, 0, x, instruction.nn); // add V[x], nn
+            written_ |= writesX;
+            return true;
+        case Op::OPCODE_8XY0:
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(0x88, RAX, x); // mov V[x], al
+            written_ |= writesX;
+            return true;
+        case Op::OPCODE_8XY1:
+        case Op::OPCODE_8XY2:
+        case Op::OPCODE_8XY3: {
+            const uint8_t opcode = instruction.op == Op::OPCODE_8XY1 ? 0x08 : instruction.op == Op::OPCODE_8XY2 ? 0x20
+                                                                                                                : 0x30;
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(opcode, RAX, x); // or, and or xor V[x], al
+            written_ |= writesX;
+            if (vfReset) {
+                emitRegisterImmediate(0xC6, 0, VF, 0x00); // mov VF, 0
+                written_ |= writesVf;
+            }
+            return true;
+        }
+        case Op::OPCODE_8XY4:
+            // The sum of two bytes never exceeds 0xFFF, so VF is always cleared like in Chip8::opcode8XY4
+            emitRegisterImmediate(0xC6, 0, VF, 0x00); // mov VF, 0
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(0x00, RAX, x); // add V[x], al
+            written_ |= writesX | writesVf;
+            return true;
+        case Op::OPCODE_8XY5:
+            emitRegisterOp(0x8A, RAX, x); // mov al, V[x]
+            emitRegisterOp(0x3A, RAX, y); // cmp al, V[y]
+            emit({0x0F, 0x93, 0xC1}); // setae cl
+            emitRegisterOp(0x88, RCX, VF); // mov VF, cl
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(0x28, RAX, x); // sub V[x], al
+            written_ |= writesX | writesVf;
+            return true;
+        case Op::OPCODE_8XY6:
+            emitRegisterOp(0x8A, RAX, x); // mov al, V[x]
+            emit({0x24, 0x01}); // and al, 1
+            emitRegisterOp(0x88, RAX, VF); // mov VF, al
+            emitRegisterOp(0x8A, RAX, shiftSource); // mov al, V[x] or V[y]
+            emit({0xD0, 0xE8}); // shr al, 1
+            emitRegisterOp(0x88, RAX, x); // mov V[x], al
+            written_ |= writesX | writesVf;
+            return true;
+        case Op::OPCODE_8XY7:
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(0x3A, RAX, x); // cmp al, V[x]
+            emit({0x0F, 0x93, 0xC1}); // setae cl
+            emitRegisterOp(0x88, RCX, VF); // mov VF, cl
+            emitRegisterOp(0x8A, RAX, y); // mov al, V[y]
+            emitRegisterOp(0x2A, RAX, x); // sub al, V[x]
+            emitRegisterOp(0x88, RAX, x); // mov V[x], al
+            written_ |= writesX | writesVf;
+            return true;
+        case Op::OPCODE_8XYE:
+            emitRegisterOp(0x8A, RAX, x); // mov al, V[x]
+            emit({0xC0, 0xE8, 0x07}); // shr al, 7
+            emitRegisterOp(0x88, RAX, VF); // mov VF, al
+            emitRegisterOp(0x8A, RAX, shiftSource); // mov al, V[x] or V[y]
+            emit({0x00, 0xC0}); // add al, al
+            emitRegisterOp(0x88, RAX, x); // mov V[x], al
+            written_ |= writesX | writesVf;
+            return true;
+        case Op::OPCODE_ANNN:
+            emitSetIndex(instruction.nnn);
+            written_ |= writesIndex;
+            return true;
+        case Op::OPCODE_FX1E:
+            emitLoadIndex(RAX); // eax = I
+            emitLoadRegister(RCX, x); // ecx = V[x]
+            emit({0x01, 0xC8}); // add eax, ecx
+            emit({0x3D, 0xFF, 0x0F, 0x00, 0x00}); // cmp eax, 0xFFF
+            emit({0x0F, 0x97, 0xC1}); // seta cl
+            emitRegisterOp(0x88, RCX, VF); // mov VF, cl
+            emitLoadRegister(RCX, x); // ecx = V[x], read again in case X is F
+            emitAddIndex(); // I += cx
+            written_ |= writesVf | writesIndex;
+            return true;
+        case Op::OPCODE_FX29:
+            emitLoadRegister(RAX, x); // eax = V[x]
+            emit({0x8D, 0x44, 0x80, 0x50}); // lea eax, [rax + rax * 4 + 0x50]
+            emitIndexFromAx(); // I = ax
+            written_ |= writesIndex;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes) {
+    for (auto byte : bytes) {
+        code_[codeEnd_++] = byte;
+    }
+}
+
+void Jit::emit32(uint32_t value) {
+    emit({static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16),
+          static_cast<uint8_t>(value >> 24)});
+}
+
+void Jit::patch32(std::size_t position, uint32_t value) {
+    for (unsigned int i = 0; i < 4; i++) {
+        code_[position + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+// Emits a byte operation between a scratch register and V[x], wherever V[x] is kept
+void Jit::emitRegisterOp(uint8_t opcode, unsigned int reg, unsigned int x) {
+    const auto host = hostRegisters_[x];
+    if (host >= 0) {
+        emit({rex(reg, host), opcode, modrm(3, reg, host)});
+    } else {
+        emit({rex(reg, RDI), opcode, modrm(1, reg, RDI), static_cast<uint8_t>(x)}); // [rdi + x]
+    }
+}
+
+// Emits a byte operation on V[x] and an immediate, where digit selects the operation
+void Jit::emitRegisterImmediate(uint8_t opcode, unsigned int digit, unsigned int x, uint8_t immediate) {
+    const auto host = hostRegisters_[x];
+    if (host >= 0) {
+        emit({rex(0, host), opcode, modrm(3, digit, host), immediate});
+    } else {
+        emit({opcode, modrm(1, digit, RDI), static_cast<uint8_t>(x), immediate});
+    }
+}
+
+// movzx reg, V[x]
+void Jit::emitLoadRegister(unsigned int reg, unsigned int x) {
+    const auto host = hostRegisters_[x];
+    if (host >= 0) {
+        emit({rex(reg, host), 0x0F, 0xB6, modrm(3, reg, host)});
+    } else {
+        emit({rex(reg, RDI), 0x0F, 0xB6, modrm(1, reg, RDI), static_cast<uint8_t>(x)});
+    }
+}
+
+// I is kept zero-extended in its host register, so it can be read with a plain mov
+void Jit::emitLoadIndex(unsigned int reg) {
+    const auto host = hostRegisters_[INDEX_SLOT];
+    if (host >= 0) {
+        emit({rex(reg, host), 0x8B, modrm(3, reg, host)}); // mov reg, I
+    } else {
+        emit({rex(reg, RSI), 0x0F, 0xB7, modrm(0, reg, RSI)}); // movzx reg, word [rsi]
+    }
+}
+
+void Jit::emitSetIndex(uint16_t value) {
+    const auto host = hostRegisters_[INDEX_SLOT];
+    if (host >= 0) {
+        emit({rex(0, host), static_cast<uint8_t>(0xB8 + (host & 7))}); // mov I, value
+        emit32(value);
+    } else {
+        emit({0x66, 0xC7, 0x06, static_cast<uint8_t>(value & 0xFF), static_cast<uint8_t>(value >> 8)});
+    }
+}
+
+// A 16-bit add wraps like I does, and leaves the upper bits of the host register 0
+void Jit::emitAddIndex() {
+    const auto host = hostRegisters_[INDEX_SLOT];
+    if (host >= 0) {
+        emit({0x66, rex(RCX, host), 0x01, modrm(3, RCX, host)}); // add I, cx
+    } else {
+        emit({0x66, 0x01, modrm(0, RCX, RSI)}); // add [rsi], cx
+    }
+}
+
+void Jit::emitIndexFromAx() {
+    const auto host = hostRegisters_[INDEX_SLOT];
+    if (host >= 0) {
+        emit({rex(host, RAX), 0x0F, 0xB7, modrm(3, host, RAX)}); // movzx I, ax
+    } else {
+        emit({0x66, 0x89, modrm(0, RAX, RSI)}); // mov [rsi], ax
+    }
+}
+
+void Jit::emitPrologue() {
+    for (const auto reg : savedRegisters_) {
+        if (reg >= R8) {
+            emit({0x41});
+        }
+        emit({static_cast<uint8_t>(0x50 + (reg & 7))}); // push reg
+    }
+
+    for (unsigned int slot = 0; slot < SLOT_COUNT; slot++) {
+        const auto host = hostRegisters_[slot];
+        if (host < 0) {
+            continue;
+        }
+        if (slot == INDEX_SLOT) {
+            emit({rex(host, RSI), 0x0F, 0xB7, modrm(0, host, RSI)}); // movzx host, word [rsi]
+        } else {
+            emit({rex(host, RDI), 0x0F, 0xB6, modrm(1, host, RDI), static_cast<uint8_t>(slot)}); // movzx host, V[slot]
+        }
+    }
+}
+
+// Stores the written registers back, restores the callee-saved registers and returns. Leaves eax and the flags alone.
+void Jit::emitEpilogue(SlotMask written) {
+    for (unsigned int slot = 0; slot < SLOT_COUNT; slot++) {
+        const auto host = hostRegisters_[slot];
+        if (host < 0 || (written >> slot & 1) == 0) {
+            continue;
+        }
+        if (slot == INDEX_SLOT) {
+            emit({0x66, rex(host, RSI), 0x89, modrm(0, host, RSI)}); // mov [rsi], host
+        } else {
+            emit({rex(host, RDI), 0x88, modrm(1, host, RDI), static_cast<uint8_t>(slot)}); // mov V[slot], host
+        }
+    }
+
+    for (auto it = savedRegisters_.rbegin(); it != savedRegisters_.rend(); it++) {
+        if (*it >= R8) {
+            emit({0x41});
+        }
+        emit({static_cast<uint8_t>(0x58 + (*it & 7))}); // pop reg
+    }
+
+    emit({0xC3}); // ret
+}
+
+void Jit::emitExit(unsigned int length, unsigned int nextAddress) {
+    emit({0xB8}); // mov eax, length << 16 | nextAddress
+    emit32(length << 16 | (nextAddress & 0xFFFF));
+    emitEpilogue(written_);
+}
+
+// Emits the exit of a skip instruction at the given address, which has just compared two values
+void Jit::emitConditionalExit(unsigned int length, unsigned int address, uint8_t condition) {
+    emit({0xB8}); // mov eax, length << 16 | (address + 2)
+    emit32(length << 16 | ((address + 2) & 0xFFFF));
+    emit({0xBA}); // mov edx, length << 16 | (address + 4)
+    emit32(length << 16 | ((address + 4) & 0xFFFF));
+    emit({0x0F, static_cast<uint8_t>(0x40 | condition), 0xC2}); // cmovcc eax, edx
+    emitEpilogue(written_);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Instruction.h"
+#include "Quirks.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+const bool JIT_SUPPORTED = true;
+#else
+const bool JIT_SUPPORTED = false;
+#endif
+
+// Translates blocks of CHIP-8 code into x86-64 machine code. Only instructions which work on the registers, I and the
+// keys are translated, and branches end a block. Everything else is left for the interpreter: a block stops just before
+// the first instruction it can't translate. Blocks are only compiled once they've been reached often enough to be worth
+// it, and the interpreter runs them until then.
+class Jit {
+public:
+    // Compiled blocks take pointers to V0 and I, the most opcodes they may execute, which is at least 1, and the
+    // pressed keys. They return the number of executed opcodes in the upper 16 bits and the address of the next
+    // instruction in the lower 16 bits.
+    using Function = uint32_t (*)(uint8_t *registers, uint16_t *index, uint32_t maxOpcodes, uint32_t keys);
+
+    struct Block {
+        Function function;
+        uint16_t length; // Number of translated opcodes. 0 if the first instruction has to be interpreted.
+        uint8_t extent; // Number of bytes of memory the block was translated from
+        bool compiled;
+    };
+
+    Jit(Quirks quirks, std::size_t memorySize);
+
+    ~Jit();
+
+    Jit(const Jit &) = delete;
+
+    Jit &operator=(const Jit &) = delete;
+
+    // Returns the block starting at the given address, compiling it first if it has become hot. Blocks which aren't
+    // compiled yet have a length of 0. Inline, as this is called for every block executed.
+    const Block &block(const uint8_t *memory, unsigned int address) {
+        const auto &cached = blocks_[address];
+        if (cached.compiled) {
+            return cached;
+        }
+        return ++hits_[address] < HOT_THRESHOLD ? INTERPRETED : compileBlock(memory, address);
+    }
+
+    void flush();
+
+    // Drops the blocks translated from the byte at the given address, which has been overwritten. Compiled blocks
+    // never write to memory, so none of them can be running.
+    void invalidate(unsigned int address);
+
+private:
+    // Times a block is reached before it's compiled
+    static const uint8_t HOT_THRESHOLD = 16;
+
+    static const Block INTERPRETED;
+
+    // Host registers which hold V registers and I while a block runs
+    static const unsigned int HOST_REGISTER_COUNT = 10;
+
+    // Slots of the registers a block can keep in host registers: V0 to VF, then I
+    static const unsigned int SLOT_COUNT = 17;
+    static const unsigned int INDEX_SLOT = 16;
+
+    using SlotMask = uint32_t;
+
+    const Block &compileBlock(const uint8_t *memory, unsigned int address);
+
+    Block compile(const uint8_t *memory, unsigned int address);
+
+    bool translate(const Instruction &instruction, unsigned int address, unsigned int length);
+
+    void allocate(const std::vector<Instruction> &instructions);
+
+    void emit(std::initializer_list<uint8_t> bytes);
+
+    void emit32(uint32_t value);
+
+    void patch32(std::size_t position, uint32_t value);
+
+    void emitRegisterOp(uint8_t opcode, unsigned int reg, unsigned int x);
+
+    void emitRegisterImmediate(uint8_t opcode, unsigned int digit, unsigned int x, uint8_t immediate);
+
+    void emitLoadRegister(unsigned int reg, unsigned int x);
+
+    void emitLoadIndex(unsigned int reg);
+
+    void emitSetIndex(uint16_t value);
+
+    void emitAddIndex();
+
+    void emitIndexFromAx();
+
+    void emitPrologue();
+
+    void emitEpilogue(SlotMask written);
+
+    void emitExit(unsigned int length, unsigned int nextAddress);
+
+    void emitConditionalExit(unsigned int length, unsigned int address, uint8_t condition);
+
+    const Quirks quirks_;
+    const std::size_t memorySize_;
+
+    // The code buffer is mapped twice: writable for emitting and executable for running, so that no page is ever both
+    // and blocks can be added without changing any protection
+    uint8_t *code_;
+    uint8_t *executableCode_;
+    std::size_t codeSize_;
+    std::size_t codeEnd_;
+
+    std::vector<Block> blocks_; // Indexed by the address of the first instruction
+    std::vector<uint8_t> hits_; // Times each address was reached while it wasn't compiled
+    std::vector<bool> compiledCode_;
+
+    // State of the block being compiled: the host register of each slot, or -1 if it stays in memory, and the slots
+    // written so far, which are stored back at every exit
+    std::array<int, SLOT_COUNT> hostRegisters_;
+    std::vector<unsigned int> savedRegisters_; // Pushed on entry: the keys if they're used, then callee-saved ones
+    SlotMask written_;
+};
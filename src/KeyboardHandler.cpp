@@ -1,8 +1,29 @@
 #include "KeyboardHandler.h"
+#include "SaveState.h"
 
 #include <SDL2/SDL_events.h>
 
-KeyboardHandler::KeyboardHandler(std::array<uint8_t, KEY_COUNT> &keys) : keys_{keys} {
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+// Events which come closer together than this are applied as far apart as they came. A key tapped for less than this
+// long is still seen as pressed for as long as it was held, even if it was pressed and released between two polls.
+static const double MAX_KEY_EVENT_DELAY_MS = 1000.0 / TIMER_FREQUENCY;
+
+KeyboardHandler::KeyboardHandler(Chip8 &chip8, std::string stateFilePrefix)
+        : chip8_{chip8},
+          stateFilePrefix_{std::move(stateFilePrefix)},
+          state_{std::make_unique<SaveState>()},
+          requestedSave_{0},
+          requestedLoad_{0},
+          rewinding_{false},
+          keyEvents_{},
+          keyEventsWritten_{0},
+          keyEventsRead_{0},
+          lastKeyEventTimestamp_{0},
+          msSinceLastKeyEvent_{MAX_KEY_EVENT_DELAY_MS} {
 }
 
 bool KeyboardHandler::handle() {
@@ -18,6 +39,8 @@ bool KeyboardHandler::handle() {
     +-+-+-+-+    +-+-+-+-+
     |A|0|B|F|    |Z|X|C|V|
     +-+-+-+-+    +-+-+-+-+
+
+    F1 to F4 save the state to slots 1 to 4, and F5 to F8 load it back from them. Holding backspace rewinds.
      */
 
     bool quit = false;
@@ -26,6 +49,7 @@ bool KeyboardHandler::handle() {
 
     while (SDL_PollEvent(&event)) {
         int keyState = 0;
+        int key = -1;
 
         switch (event.type) {
             case SDL_QUIT:
@@ -45,55 +69,178 @@ bool KeyboardHandler::handle() {
                 quit = true;
                 break;
             case SDLK_1:
-                keys_[0x1] = keyState;
+                key = 0x1;
                 break;
             case SDLK_2:
-                keys_[0x2] = keyState;
+                key = 0x2;
                 break;
             case SDLK_3:
-                keys_[0x3] = keyState;
+                key = 0x3;
                 break;
             case SDLK_4:
-                keys_[0xC] = keyState;
+                key = 0xC;
                 break;
             case SDLK_q:
-                keys_[0x4] = keyState;
+                key = 0x4;
                 break;
             case SDLK_w:
-                keys_[0x5] = keyState;
+                key = 0x5;
                 break;
             case SDLK_e:
-                keys_[0x6] = keyState;
+                key = 0x6;
                 break;
             case SDLK_r:
-                keys_[0xD] = keyState;
+                key = 0xD;
                 break;
             case SDLK_a:
-                keys_[0x7] = keyState;
+                key = 0x7;
                 break;
             case SDLK_s:
-                keys_[0x8] = keyState;
+                key = 0x8;
                 break;
             case SDLK_d:
-                keys_[0x9] = keyState;
+                key = 0x9;
                 break;
             case SDLK_f:
-                keys_[0xE] = keyState;
+                key = 0xE;
                 break;
             case SDLK_z:
-                keys_[0xA] = keyState;
+                key = 0xA;
                 break;
             case SDLK_x:
-                keys_[0x0] = keyState;
+                key = 0x0;
                 break;
             case SDLK_c:
-                keys_[0xB] = keyState;
+                key = 0xB;
                 break;
             case SDLK_v:
-                keys_[0xF] = keyState;
+                key = 0xF;
                 break;
         }
+
+        // Repeated key downs don't change the keypad
+        if (key >= 0 && (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat) {
+            queueKeyEvent({event.key.timestamp, static_cast<uint8_t>(key), keyState == 1});
+        }
+
+        if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && event.key.keysym.sym == SDLK_BACKSPACE) {
+            rewinding_ = keyState == 1;
+        }
+
+        if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+            switch (event.key.keysym.sym) {
+                case SDLK_F1:
+                    requestedSave_ = 1;
+                    break;
+                case SDLK_F2:
+                    requestedSave_ = 2;
+                    break;
+                case SDLK_F3:
+                    requestedSave_ = 3;
+                    break;
+                case SDLK_F4:
+                    requestedSave_ = 4;
+                    break;
+                case SDLK_F5:
+                    requestedLoad_ = 1;
+                    break;
+                case SDLK_F6:
+                    requestedLoad_ = 2;
+                    break;
+                case SDLK_F7:
+                    requestedLoad_ = 3;
+                    break;
+                case SDLK_F8:
+                    requestedLoad_ = 4;
+                    break;
+            }
+        }
     }
 
     return quit;
 }
+
+void KeyboardHandler::queueKey(uint32_t timestamp, unsigned int key, bool pressed) {
+    queueKeyEvent({timestamp, static_cast<uint8_t>(key), pressed});
+}
+
+void KeyboardHandler::applyStateRequests() {
+    if (const auto slot = requestedSave_.exchange(0); slot != 0) {
+        saveSlot(slot);
+    }
+    if (const auto slot = requestedLoad_.exchange(0); slot != 0) {
+        loadSlot(slot);
+    }
+}
+
+// Failing to save or load a slot is reported without stopping the emulator
+void KeyboardHandler::saveSlot(unsigned int slot) {
+    try {
+        chip8_.saveState(*state_);
+        writeStateFile(slotPath(slot), *state_);
+        std::cout << "Saved state to slot " << slot << "\n";
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Can't save slot " << slot << ": " << e.what() << "\n";
+    }
+}
+
+void KeyboardHandler::loadSlot(unsigned int slot) {
+    try {
+        readStateFile(slotPath(slot), *state_);
+        chip8_.loadState(*state_);
+        std::cout << "Loaded state from slot " << slot << "\n";
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Can't load slot " << slot << ": " << e.what() << "\n";
+    }
+}
+
+void KeyboardHandler::applyKeyEvents(double elapsedMs) {
+    msSinceLastKeyEvent_ += elapsedMs;
+
+    while (msUntilNextKeyEvent() == 0) {
+        applyFirstKeyEvent();
+    }
+}
+
+double KeyboardHandler::msUntilNextKeyEvent() const {
+    const auto read = keyEventsRead_.load(std::memory_order_relaxed);
+    if (read == keyEventsWritten_.load(std::memory_order_acquire)) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    const auto &event = keyEvents_[read % keyEvents_.size()];
+    const auto delay = std::min(static_cast<double>(event.timestamp - lastKeyEventTimestamp_), MAX_KEY_EVENT_DELAY_MS);
+    return std::max(0.0, delay - msSinceLastKeyEvent_);
+}
+
+void KeyboardHandler::queueKeyEvent(const KeyEvent &event) {
+    // Only if the emulator has stopped taking events, in which case there's nothing better to do with them
+    const auto written = keyEventsWritten_.load(std::memory_order_relaxed);
+    if (written - keyEventsRead_.load(std::memory_order_acquire) == keyEvents_.size()) {
+        std::cerr << "Too many key events are waiting, dropping one\n";
+        return;
+    }
+
+    keyEvents_[written % keyEvents_.size()] = event;
+    keyEventsWritten_.store(written + 1, std::memory_order_release);
+}
+
+void KeyboardHandler::applyFirstKeyEvent() {
+    const auto read = keyEventsRead_.load(std::memory_order_relaxed);
+    const auto &event = keyEvents_[read % keyEvents_.size()];
+    chip8_.setKey(event.key, event.pressed);
+    lastKeyEventTimestamp_ = event.timestamp;
+    msSinceLastKeyEvent_ = 0;
+
+    keyEventsRead_.store(read + 1, std::memory_order_release);
+}
+
+bool KeyboardHandler::rewinding() const {
+    return rewinding_;
+}
+
+std::string KeyboardHandler::slotPath(unsigned int slot) const {
+    return stateFilePrefix_ + ".state" + std::to_string(slot);
+}
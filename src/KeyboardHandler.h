@@ -1,16 +1,79 @@
 #pragma once
 
+#include "Chip8.h"
 #include "Constants.h"
 
 #include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
 
+// Events are handled on the thread which owns the window, while the keypad events and save state requests they
+// produce are applied on the thread running the emulator. The two only share lock-free queues and atomics.
 class KeyboardHandler {
 public:
-    explicit KeyboardHandler(std::array<uint8_t, KEY_COUNT> &keys);
+    // Save states are written to files named after stateFilePrefix and the number of their slot
+    KeyboardHandler(Chip8 &chip8, std::string stateFilePrefix);
 
+    // Handles the pending SDL events. Keypad events are only queued, and are applied by applyKeyEvents. Save state
+    // hotkeys are carried out by applyStateRequests.
     bool handle();
 
+    // Queues a keypad key being pressed or released at the given time in milliseconds, for input which doesn't come
+    // from SDL. The times only need to be comparable with each other.
+    void queueKey(uint32_t timestamp, unsigned int key, bool pressed);
+
+    // Saves or loads the slot requested by the last hotkey, if any
+    void applyStateRequests();
+
+    // Applies the queued keypad events which are due after this much more emulated time, so that key presses take
+    // effect between the instructions they happened between.
+    void applyKeyEvents(double elapsedMs);
+
+    // Emulated time until the next queued keypad event is due, or infinity if there are none
+    [[nodiscard]] double msUntilNextKeyEvent() const;
+
+    // Whether the rewind key is held down
+    [[nodiscard]] bool rewinding() const;
+
 private:
-    std::array<uint8_t, KEY_COUNT> &keys_;
+    // A keypad key being pressed or released, at the time SDL gives it in milliseconds
+    struct KeyEvent {
+        uint32_t timestamp;
+        uint8_t key;
+        bool pressed;
+    };
+
+    void queueKeyEvent(const KeyEvent &event);
+
+    void applyFirstKeyEvent();
+
+    void saveSlot(unsigned int slot);
+
+    void loadSlot(unsigned int slot);
+
+    [[nodiscard]] std::string slotPath(unsigned int slot) const;
+
+    Chip8 &chip8_;
+
+    const std::string stateFilePrefix_;
+    const std::unique_ptr<SaveState> state_; // Reused for every slot, as it's too big for the stack
+
+    // Slots to save to and load from, or 0 for none
+    std::atomic<unsigned int> requestedSave_;
+    std::atomic<unsigned int> requestedLoad_;
+
+    std::atomic<bool> rewinding_;
+
+    // Ring of the events which haven't been applied yet. Only handle() moves the write count on, and only the
+    // emulator moves the read count on.
+    std::array<KeyEvent, 256> keyEvents_;
+    std::atomic<std::size_t> keyEventsWritten_;
+    std::atomic<std::size_t> keyEventsRead_;
+
+    // Only used by the emulator
+    uint32_t lastKeyEventTimestamp_;
+    double msSinceLastKeyEvent_;
 };
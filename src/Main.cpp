@@ -2,11 +2,275 @@
 #include "Chip8.h"
 #include "Config.h"
 #include "Configurator.h"
+#include "FrameExport.h"
+#include "FramePacer.h"
 #include "KeyboardHandler.h"
 #include "Renderer.h"
-#include "Timer.h"
+#include "Rewind.h"
+#include "TerminalInput.h"
+#include "TerminalRenderer.h"
+#include "TripleBuffer.h"
+#include "VideoCapture.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <thread>
+
+// A snapshot is recorded every few frames, which gives about 5 minutes of rewind at most. The snapshots of most ROMs
+// take up less than the buffer in that time.
+const unsigned int REWIND_INTERVAL = 2;
+const std::size_t REWIND_SNAPSHOTS = 5 * 60 * TIMER_FREQUENCY / REWIND_INTERVAL;
+const std::size_t REWIND_BUFFER_SIZE = 1024 * 1024;
+
+// Runs one frame's worth of instructions. Key events polled since the last frame are applied between the instructions
+// they fall between, and idle loops are skipped rather than run.
+void runFrame(Chip8 &chip8, KeyboardHandler &keyboardHandler, unsigned int cycles, double msPerCycle) {
+    keyboardHandler.applyKeyEvents(0);
+
+    while (cycles > 0) {
+        const auto untilKeyEvent = std::ceil(keyboardHandler.msUntilNextKeyEvent() / msPerCycle);
+        auto slice = untilKeyEvent < cycles ? std::max(1u, static_cast<unsigned int>(untilKeyEvent)) : cycles;
+
+        if (const auto idleCycles = chip8.idleCycles(slice); idleCycles > 0) {
+            chip8.skipIdleCycles(idleCycles);
+            slice = idleCycles;
+        } else {
+            chip8.run(slice);
+        }
+
+        keyboardHandler.applyKeyEvents(slice * msPerCycle);
+        cycles -= slice;
+    }
+}
+
+// A frame handed to the render thread, with the rows which changed since the last frame it was handed
+struct Frame {
+    Video video;
+    uint64_t dirtyRows;
+};
+
+// Emulates 60 frames per second until running is cleared. Every frame the ROM drew is handed to the render thread.
+void emulate(Chip8 &chip8, KeyboardHandler &keyboardHandler, Audio &audio, TripleBuffer<Frame> &frames,
+             const Config &config, unsigned int cyclesPerTimerTick, const std::atomic<bool> &running) {
+    const double msPerCycle = 1000.0 / config.cpuFrequency_;
+
+    // Rewinding steps back through the snapshots as fast as they were recorded
+    Rewind rewind{REWIND_BUFFER_SIZE, REWIND_SNAPSHOTS};
+    unsigned int framesUntilSnapshot = REWIND_INTERVAL;
+
+    // With run-ahead, every frame is shown as it will be after the following frames, which are emulated with the
+    // current input and then rolled back. Rolling back restores the timers, so the speculative frames make no sound.
+    // Loading a state sets the draw flag, which is cleared straight after, so only the speculative frames are drawn.
+    const bool runAhead = config.runAhead_ > 0;
+    const auto runAheadState = std::make_unique<SaveState>();
+
+    // The rows of frames the render thread never got are carried over into the next frame
+    uint64_t droppedRows = 0;
+    const auto publish = [&frames, &chip8, &droppedRows]() {
+        auto &frame = frames.writeBuffer();
+        frame.video = chip8.video();
+        frame.dirtyRows = chip8.dirtyRows() | droppedRows;
+        chip8.clearDirtyRows();
+
+        const auto dirtyRows = frame.dirtyRows;
+        droppedRows = frames.publish() ? dirtyRows : 0;
+    };
+
+    // Every frame is exported as it is at the end of the frame, including while rewinding
+    const auto frameExport = config.exportName_.empty() ? nullptr : std::make_unique<FrameExport>(config.exportName_);
+
+    FramePacer pacer{TIMER_FREQUENCY};
+    unsigned int framesUntilStats = TIMER_FREQUENCY;
+
+    while (running) {
+        keyboardHandler.applyStateRequests();
+
+        const bool snapshotDue = --framesUntilSnapshot == 0;
+        if (snapshotDue) {
+            framesUntilSnapshot = REWIND_INTERVAL;
+        }
+
+        if (keyboardHandler.rewinding()) {
+            if (snapshotDue && rewind.pop(chip8)) {
+                publish();
+                chip8.disableDrawFlag();
+            }
+        } else {
+            runFrame(chip8, keyboardHandler, cyclesPerTimerTick, msPerCycle);
+
+            if (snapshotDue) {
+                rewind.push(chip8);
+            }
+
+            if (runAhead) {
+                chip8.saveState(*runAheadState);
+                chip8.run(cyclesPerTimerTick * static_cast<unsigned int>(config.runAhead_));
+                publish();
+                chip8.loadState(*runAheadState);
+                chip8.disableDrawFlag();
+            }
+
+            if (chip8.drawFlag()) {
+                publish();
+                chip8.disableDrawFlag();
+            }
+
+        }
+
+        if (frameExport) {
+            frameExport->publish(chip8.video(), chip8.keys());
+        }
+
+        // Rewinding plays back the frames silently
+        const bool soundActive = chip8.soundActive() && !keyboardHandler.rewinding();
+
+        // Synced to the audio clock, the emulator waits for the device to play its frames instead of for the time
+        if (config.audioSync_) {
+            audio.queueFrame(soundActive, chip8.audioPattern());
+            audio.waitForFrame();
+        } else {
+            audio.update(soundActive, chip8.audioPattern());
+            pacer.waitForNextFrame();
+        }
+
+        if (config.showTiming_ && --framesUntilStats == 0) {
+            framesUntilStats = TIMER_FREQUENCY;
+
+            if (config.audioSync_) {
+                const auto stats = audio.takeSyncStats();
+                std::cout << "Frames: " << stats.frames << ", audio underruns: " << stats.underruns
+                          << ", overruns: " << stats.overruns;
+            } else {
+                const auto stats = pacer.takeStats();
+                std::cout << "Frames: " << stats.frames << ", jitter: " << stats.meanJitterMs << " ms mean, "
+                          << stats.maxJitterMs << " ms max, busy: " << stats.busyPercent << "%";
+            }
+            std::cout << ", dropped: " << frames.dropped() << ", refreshes without a new frame: "
+                      << frames.emptyUpdates() << "\n";
+        }
+    }
+}
+
+// Runs the ROM without a window or sound, as fast as it goes, and captures every frame
+void capture(Chip8 &chip8, const Config &config, unsigned int cyclesPerTimerTick) {
+    VideoCapture videoCapture{config.capturePath_, config.captureFormat_, config.captureSkipDuplicates_,
+                              schemePalette(config.colourScheme_)};
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int frame = 0; frame < config.captureFrames_; frame++) {
+        for (unsigned int cycles = cyclesPerTimerTick; cycles > 0;) {
+            if (const auto idleCycles = chip8.idleCycles(cycles); idleCycles > 0) {
+                chip8.skipIdleCycles(idleCycles);
+                cycles -= idleCycles;
+            } else {
+                chip8.run(cycles);
+                cycles = 0;
+            }
+        }
+
+        videoCapture.addFrame(chip8.video(), chip8.dirtyRows());
+        chip8.clearDirtyRows();
+    }
+    videoCapture.finish();
+
+    // The frames may be going to stdout, so this goes to stderr
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "Captured " << videoCapture.framesAdded() << " frames (" << videoCapture.framesWritten()
+              << " written) in " << elapsed.count() << " s, "
+              << videoCapture.framesAdded() / static_cast<double>(TIMER_FREQUENCY) / std::max(elapsed.count(), 1e-9)
+              << " times real time\n";
+}
+
+// Runs the emulator on its own thread, so that presenting can't hold it up, while frontEnd handles input and draws
+// the frames on this one until it returns. SDL wants events and rendering on the thread which created the window, so
+// front ends are created on this thread, and outlive the emulator. Neither thread ever waits for the other.
+template <typename FrontEnd>
+void runEmulator(Chip8 &chip8, KeyboardHandler &keyboardHandler, Audio &audio, const Config &config,
+                 unsigned int cyclesPerTimerTick, FrontEnd frontEnd) {
+    const auto frames = std::make_unique<TripleBuffer<Frame>>();
+    std::atomic<bool> running{true};
+    std::exception_ptr emulationError;
+
+    std::thread emulation{[&] {
+        try {
+            emulate(chip8, keyboardHandler, audio, *frames, config, cyclesPerTimerTick, running);
+        }
+        catch (...) {
+            emulationError = std::current_exception();
+        }
+        running = false;
+    }};
+
+    try {
+        frontEnd(*frames, running);
+    }
+    catch (...) {
+        running = false;
+        emulation.join();
+        throw;
+    }
+
+    emulation.join();
+    if (emulationError) {
+        std::rethrow_exception(emulationError);
+    }
+}
+
+// Handles events and draws the frames of the emulator in a window, until quitting or the emulator stopping
+void runInWindow(Chip8 &chip8, KeyboardHandler &keyboardHandler, Audio &audio, const Config &config,
+                 unsigned int cyclesPerTimerTick) {
+    Renderer renderer{"CHIP-8 Emulator", VIDEO_WIDTH, VIDEO_HEIGHT, config.videoScale_, config.filter_,
+                      schemePalette(config.colourScheme_)};
+
+    runEmulator(chip8, keyboardHandler, audio, config, cyclesPerTimerTick,
+                [&](TripleBuffer<Frame> &frames, std::atomic<bool> &running) {
+        FramePacer pacer{static_cast<double>(renderer.refreshRate())};
+
+        while (running) {
+            if (keyboardHandler.handle()) {
+                running = false;
+            }
+
+            if (frames.update()) {
+                renderer.update(frames.readBuffer().video, frames.readBuffer().dirtyRows);
+            }
+            renderer.present();
+
+            pacer.waitForNextFrame();
+        }
+    });
+}
+
+// The same in the terminal. Input is polled every frame, while the terminal is only updated at its own frame rate.
+void runInTerminal(Chip8 &chip8, KeyboardHandler &keyboardHandler, Audio &audio, const Config &config,
+                   unsigned int cyclesPerTimerTick) {
+    TerminalInput input{keyboardHandler};
+    TerminalRenderer renderer{static_cast<unsigned int>(config.terminalFrameRate_),
+                              schemePalette(config.colourScheme_)};
+
+    runEmulator(chip8, keyboardHandler, audio, config, cyclesPerTimerTick,
+                [&](TripleBuffer<Frame> &frames, std::atomic<bool> &running) {
+        FramePacer pacer{TIMER_FREQUENCY};
+
+        while (running) {
+            if (input.handle()) {
+                running = false;
+            }
+
+            if (frames.update()) {
+                renderer.update(frames.readBuffer().video, frames.readBuffer().dirtyRows);
+            }
+            renderer.present();
+
+            pacer.waitForNextFrame();
+        }
+    });
+}
 
 int main(int argc, char **argv) {
     try {
@@ -14,33 +278,23 @@ int main(int argc, char **argv) {
         Config config{};
         configurator.configure(config);
 
-        Chip8 chip8{config.mode_};
+        // Each frame runs a batch of instructions, which tick the timers once as they're ticked by the emulated clock
+        const auto cyclesPerTimerTick = std::max(1u, static_cast<unsigned int>(config.cpuFrequency_) / TIMER_FREQUENCY);
+        Chip8 chip8{config.mode_, config.quirks_, config.engine_, cyclesPerTimerTick};
         chip8.loadRom(config.romPath_);
 
-        KeyboardHandler keyboardHandler(chip8.keys());
-        Renderer renderer{"CHIP-8 Emulator", VIDEO_WIDTH, VIDEO_HEIGHT, config.videoScale_};
-        Audio audio{config.mute_};
-
-        const double cycleDelay = (1.0 / config.cpuFrequency_) * 1000000000;
-        Timer cycleTimer(cycleDelay);
-
-        bool quit = false;
-
-        while (!quit) {
-            quit = keyboardHandler.handle();
+        if (!config.capturePath_.empty()) {
+            capture(chip8, config, cyclesPerTimerTick);
+            return EXIT_SUCCESS;
+        }
 
-            if (cycleTimer.intervalElapsed()) {
-                chip8.cycle();
+        KeyboardHandler keyboardHandler(chip8, config.romPath_);
+        Audio audio{config.mute_, config.audioSync_};
 
-                if (chip8.drawFlag()) {
-                    auto buffer = chip8.video();
-                    renderer.update(buffer, sizeof(buffer[0]) * VIDEO_WIDTH);
-                    chip8.disableDrawFlag();
-                } else if (chip8.soundFlag()) {
-                    audio.play();
-                    chip8.disableSoundFlag();
-                }
-            }
+        if (config.terminal_) {
+            runInTerminal(chip8, keyboardHandler, audio, config, cyclesPerTimerTick);
+        } else {
+            runInWindow(chip8, keyboardHandler, audio, config, cyclesPerTimerTick);
         }
     }
     catch (const std::exception &e) {
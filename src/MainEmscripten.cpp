@@ -7,8 +7,8 @@
 #include <emscripten.h>
 
 Config config{};
-Chip8 chip8{config.mode_};
-KeyboardHandler keyboardHandler(chip8.keys());
+Chip8 chip8{config.mode_, config.quirks_, config.engine_, 0}; // Timers are ticked once per browser frame in mainLoop
+KeyboardHandler keyboardHandler(chip8, "/chip8"); // Save states only live in the in-memory file system
 Renderer renderer{"WASM CHIP-8 Emulator", VIDEO_WIDTH, VIDEO_HEIGHT, 13};
 int cyclesPerFrame = 10;
 
@@ -24,23 +24,28 @@ void stop() {
     emscripten_cancel_main_loop();
 
     chip8.reset();
-    auto buffer = chip8.video();
-    renderer.update(buffer, sizeof(buffer[0]) * VIDEO_WIDTH);
+    renderer.update(chip8.video(), chip8.dirtyRows());
+    chip8.clearDirtyRows();
+    renderer.presentNow();
 }
 }
 
 void mainLoop() {
     keyboardHandler.handle();
+    keyboardHandler.applyStateRequests();
+    keyboardHandler.applyKeyEvents(1000.0 / TIMER_FREQUENCY);
 
-    for (int i = 0; i < cyclesPerFrame; i++) {
-        chip8.cycle();
-    }
+    chip8.run(cyclesPerFrame);
+
+    chip8.tick();
 
     if (chip8.drawFlag()) {
-        auto buffer = chip8.video();
-        renderer.update(buffer, sizeof(buffer[0]) * VIDEO_WIDTH);
+        renderer.update(chip8.video(), chip8.dirtyRows());
+        chip8.clearDirtyRows();
         chip8.disableDrawFlag();
     }
+
+    renderer.present();
 }
 
 int main() {
@@ -3,5 +3,6 @@
 enum class Mode {
     CHIP8,
     CHIP48,
-    SCHIP // NOTE: SCHIP opcodes aren't actually implemented. Check the README for an explanation.
+    SCHIP,
+    XOCHIP
 };
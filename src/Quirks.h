@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Mode.h"
+
+// Behaviours which differ between CHIP-8 interpreters. Each mode enables a set of these, and further quirks can be
+// turned on individually.
+// See: https://github.com/Timendus/chip8-test-suite#quirks-test
+enum class Quirk : unsigned int {
+    SHIFT_VY = 1 << 0, // 8XY6 and 8XYE shift VY into VX, instead of shifting VX in place
+    LOAD_STORE_INCREMENT = 1 << 1, // FX55 and FX65 leave I pointing after the last register they load or store
+    VF_RESET = 1 << 2, // 8XY1, 8XY2 and 8XY3 set VF to 0
+    CLIP_SPRITES = 1 << 3, // DXYN clips sprites at the edges of the screen, instead of wrapping them around
+    JUMP_VX = 1 << 4 // BXNN jumps to XNN + VX, instead of NNN + V0
+};
+
+// A combination of quirks, one bit per Quirk
+using Quirks = unsigned int;
+
+const unsigned int QUIRK_COUNT = 5;
+
+// Used in place of a set of quirks to read the quirks from the emulator at run time instead
+const Quirks RUNTIME_QUIRKS = 1 << QUIRK_COUNT;
+
+constexpr Quirks quirkBit(Quirk quirk) {
+    return static_cast<Quirks>(quirk);
+}
+
+constexpr Quirks modeQuirks(Mode mode) {
+    switch (mode) {
+        case Mode::CHIP8:
+            return quirkBit(Quirk::SHIFT_VY) | quirkBit(Quirk::LOAD_STORE_INCREMENT);
+        case Mode::CHIP48:
+        case Mode::XOCHIP:
+            return quirkBit(Quirk::LOAD_STORE_INCREMENT);
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// The same generator as std::minstd_rand0, which is what std::default_random_engine is on GCC, but with its state
+// exposed so that it can be saved and restored
+class RandomEngine {
+public:
+    using result_type = uint32_t;
+
+    explicit RandomEngine(uint64_t seed = 1) {
+        this->seed(seed);
+    }
+
+    void seed(uint64_t seed) {
+        state_ = static_cast<result_type>(seed % MODULUS);
+        if (state_ == 0) {
+            state_ = 1;
+        }
+    }
+
+    result_type operator()() {
+        state_ = static_cast<result_type>(uint64_t{state_} * MULTIPLIER % MODULUS);
+        return state_;
+    }
+
+    // Seeding the engine with its state restores it
+    [[nodiscard]] result_type state() const {
+        return state_;
+    }
+
+    static constexpr result_type min() {
+        return 1;
+    }
+
+    static constexpr result_type max() {
+        return MODULUS - 1;
+    }
+
+private:
+    static constexpr result_type MULTIPLIER = 16807;
+    static constexpr result_type MODULUS = 2147483647;
+
+    result_type state_;
+};
@@ -1,8 +1,13 @@
 #include "Renderer.h"
 
+#include <algorithm>
 #include <stdexcept>
 
-Renderer::Renderer(const std::string &title, const int videoWidth, const int videoHeight, const int videoScale) {
+static const Uint32 PRESENT_TOLERANCE_MS = 2;
+
+Renderer::Renderer(const std::string &title, const int videoWidth, const int videoHeight, const int videoScale,
+                   const Filter filter, const Palette &palette)
+        : filter_{filter}, palette_{palette}, filterScale_{0}, indices_{} {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         throw std::runtime_error("Failed to initialize SDL video: " + std::string(SDL_GetError()));
     }
@@ -12,8 +17,38 @@ Renderer::Renderer(const std::string &title, const int videoWidth, const int vid
 
     renderer_ = SDL_CreateRenderer(window_, -1, SDL_RENDERER_ACCELERATED);
 
-    texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, videoWidth,
-                                 videoHeight);
+    // The borders left around a filtered screen are the colour of pixels which are off
+    SDL_SetRenderDrawColor(renderer_, palette_[0] >> 24, palette_[0] >> 16 & 0xFF, palette_[0] >> 8 & 0xFF, 0xFF);
+
+    // Windows on high DPI displays can have more pixels than their size
+    if (SDL_GetRendererOutputSize(renderer_, &outputWidth_, &outputHeight_) != 0) {
+        outputWidth_ = videoWidth * videoScale;
+        outputHeight_ = videoHeight * videoScale;
+    }
+
+    // Big enough for the high resolution mode. Lower resolutions only use its top left corner. Filtered screens are
+    // never smaller than the factor of the filter, even if the window is.
+    int textureWidth = HIRES_VIDEO_WIDTH;
+    int textureHeight = HIRES_VIDEO_HEIGHT;
+    if (filter_ != Filter::NONE) {
+        const auto factor = static_cast<int>(filterFactor(filter_));
+        textureWidth = std::max(outputWidth_, textureWidth * factor);
+        textureHeight = std::max(outputHeight_, textureHeight * factor);
+    }
+    texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth,
+                                 textureHeight);
+
+    area_ = {0, 0, static_cast<int>(VIDEO_WIDTH), static_cast<int>(VIDEO_HEIGHT)};
+    presentPending_ = false;
+
+    // Displays which don't report their refresh rate are assumed to run at 60 Hz
+    SDL_DisplayMode mode{};
+    const int displayIndex = SDL_GetWindowDisplayIndex(window_);
+    const bool knownRate = displayIndex >= 0 && SDL_GetCurrentDisplayMode(displayIndex, &mode) == 0 &&
+                           mode.refresh_rate > 0;
+    refreshRate_ = knownRate ? static_cast<unsigned int>(mode.refresh_rate) : 60;
+    refreshIntervalMs_ = 1000 / refreshRate_;
+    lastPresentMs_ = SDL_GetTicks() - refreshIntervalMs_;
 }
 
 Renderer::~Renderer() {
@@ -23,9 +58,100 @@ Renderer::~Renderer() {
     SDL_Quit();
 }
 
-void Renderer::update(const std::array<uint32_t, VIDEO_WIDTH * VIDEO_HEIGHT> &video, int pitch) const {
-    SDL_UpdateTexture(texture_, nullptr, video.data(), pitch);
+void Renderer::update(const Video &video, uint64_t dirtyRows) {
+    if (filter_ != Filter::NONE) {
+        updateFiltered(video, dirtyRows);
+        return;
+    }
+
+    area_ = {0, 0, static_cast<int>(video.width), static_cast<int>(video.height)};
+
+    dirtyRows &= allRows(video.height);
+    if (dirtyRows == 0) {
+        return;
+    }
+
+    // Only the band of rows from the first dirty row to the last one is uploaded
+    const auto firstRow = static_cast<unsigned int>(__builtin_ctzll(dirtyRows));
+    const auto endRow = 64 - static_cast<unsigned int>(__builtin_clzll(dirtyRows));
+    const SDL_Rect band{0, static_cast<int>(firstRow), area_.w, static_cast<int>(endRow - firstRow)};
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture_, &band, &pixels, &pitch) != 0) {
+        throw std::runtime_error("Failed to lock the screen texture: " + std::string(SDL_GetError()));
+    }
+    expandVideoRows(video, firstRow, endRow, static_cast<uint32_t *>(pixels),
+                    static_cast<std::size_t>(pitch) / sizeof(uint32_t), palette_);
+    SDL_UnlockTexture(texture_);
+
+    presentPending_ = true;
+}
+
+void Renderer::updateFiltered(const Video &video, uint64_t dirtyRows) {
+    // The scale changes with the resolution, which redraws every row
+    const auto scale = filterScale(filter_, video.width, video.height, static_cast<unsigned int>(outputWidth_),
+                                   static_cast<unsigned int>(outputHeight_));
+    const SDL_Rect area{0, 0, static_cast<int>(video.width * scale), static_cast<int>(video.height * scale)};
+    if (scale != filterScale_ || area.w != area_.w || area.h != area_.h) {
+        filterScale_ = scale;
+        area_ = area;
+        dirtyRows = allRows(video.height);
+    }
+
+    dirtyRows &= allRows(video.height);
+    if (dirtyRows == 0) {
+        return;
+    }
+
+    const auto firstDirty = static_cast<unsigned int>(__builtin_ctzll(dirtyRows));
+    const auto endDirty = 64 - static_cast<unsigned int>(__builtin_clzll(dirtyRows));
+    indexVideoRows(video, firstDirty, endDirty, indices_);
+
+    // Scale2x and Scale3x look at the rows above and below each pixel, so the rows next to the band change too
+    const bool neighbours = filterFactor(filter_) > 1;
+    const auto firstRow = neighbours && firstDirty > 0 ? firstDirty - 1 : firstDirty;
+    const auto endRow = neighbours && endDirty < video.height ? endDirty + 1 : endDirty;
+    const SDL_Rect band{0, static_cast<int>(firstRow * scale), area_.w, static_cast<int>((endRow - firstRow) * scale)};
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture_, &band, &pixels, &pitch) != 0) {
+        throw std::runtime_error("Failed to lock the screen texture: " + std::string(SDL_GetError()));
+    }
+    upscaleRows(filter_, indices_, video.width, video.height, firstRow, endRow, scale, palette_,
+                static_cast<uint32_t *>(pixels), static_cast<std::size_t>(pitch) / sizeof(uint32_t));
+    SDL_UnlockTexture(texture_);
+
+    presentPending_ = true;
+}
+
+void Renderer::present() {
+    // Allow for a little jitter, so that frames paced at the refresh rate aren't dropped. Updates which are too soon
+    // are presented with the next frame instead.
+    const auto now = SDL_GetTicks();
+    if (!presentPending_ || now - lastPresentMs_ + PRESENT_TOLERANCE_MS < refreshIntervalMs_) {
+        return;
+    }
+
+    presentNow();
+}
+
+unsigned int Renderer::refreshRate() const {
+    return refreshRate_;
+}
+
+void Renderer::presentNow() {
     SDL_RenderClear(renderer_);
-    SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
+    if (filter_ == Filter::NONE || area_.w > outputWidth_ || area_.h > outputHeight_) {
+        SDL_RenderCopy(renderer_, texture_, &area_, nullptr);
+    } else {
+        // Filtered screens are copied pixel for pixel into the middle of the window
+        const SDL_Rect destination{(outputWidth_ - area_.w) / 2, (outputHeight_ - area_.h) / 2, area_.w, area_.h};
+        SDL_RenderCopy(renderer_, texture_, &area_, &destination);
+    }
     SDL_RenderPresent(renderer_);
+
+    presentPending_ = false;
+    lastPresentMs_ = SDL_GetTicks();
 }
@@ -1,22 +1,55 @@
 #pragma once
 
 #include "Constants.h"
+#include "Filter.h"
+#include "Upscale.h"
+#include "Video.h"
 
 #include <SDL2/SDL.h>
 
-#include <array>
 #include <string>
 
 class Renderer {
 public:
-    Renderer(const std::string &title, int videoWidth, int videoHeight, int videoScale);
+    // Filters other than none scale the screen on the CPU to the largest size which fits the window, so that the
+    // renderer only has to copy it. That's much faster where SDL falls back to its software renderer.
+    Renderer(const std::string &title, int videoWidth, int videoHeight, int videoScale, Filter filter = Filter::NONE,
+             const Palette &palette = PALETTE);
 
     ~Renderer();
 
-    void update(const std::array<uint32_t, VIDEO_WIDTH * VIDEO_HEIGHT> &pixels, int pitch) const;
+    // Expands (or filters) the dirty rows straight into the texture, and nothing at all if no rows are dirty. Only the
+    // latest update before a present is shown.
+    void update(const Video &video, uint64_t dirtyRows);
+
+    // Presents the last update stretched over the window at any resolution, unless nothing was updated since the last
+    // present, or the display hasn't refreshed since
+    void present();
+
+    // Presents the last update straight away
+    void presentNow();
+
+    // Of the display the window is on, in hertz
+    [[nodiscard]] unsigned int refreshRate() const;
 
 private:
+    void updateFiltered(const Video &video, uint64_t dirtyRows);
+
     SDL_Window *window_;
     SDL_Renderer *renderer_;
     SDL_Texture *texture_;
+
+    SDL_Rect area_; // Part of the texture used at the current resolution
+    bool presentPending_;
+
+    Filter filter_;
+    Palette palette_;
+    int outputWidth_; // Of the window, in pixels
+    int outputHeight_;
+    unsigned int filterScale_; // Of the screen at the current resolution
+    VideoIndices indices_; // Of the screen as last updated, which filters compare neighbouring pixels of
+
+    unsigned int refreshRate_;
+    Uint32 refreshIntervalMs_;
+    Uint32 lastPresentMs_;
 };
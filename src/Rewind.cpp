@@ -0,0 +1,196 @@
+#include "Rewind.h"
+
+#include <cstring>
+#include <utility>
+
+// Unchanged bytes shorter than this are kept in the literals around them, as a new run would cost as much
+static const std::size_t MIN_ZERO_RUN = 4;
+
+// A delta can't be larger than this, as every run of literals is followed by a run of zeroes at least MIN_ZERO_RUN long
+static const std::size_t MAX_DELTA_SIZE = SAVE_STATE_SIZE + (SAVE_STATE_SIZE / MIN_ZERO_RUN + 1) * 6;
+
+static uint8_t *putVarint(uint8_t *out, std::size_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static std::size_t getVarint(const uint8_t *&in) {
+    std::size_t value = 0;
+    for (unsigned int shift = 0;; shift += 7) {
+        const auto byte = *in++;
+        value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+// Encodes from XOR to as pairs of runs: the number of bytes which are the same in both, then the number of bytes
+// which differ followed by their XOR. Trailing bytes which are the same aren't encoded. Returns the end of the delta.
+static uint8_t *encodeDelta(const SaveState &from, const SaveState &to, uint8_t *out) {
+    std::size_t position = 0;
+
+    while (position < SAVE_STATE_SIZE) {
+        // Skip unchanged bytes a word at a time, as most of them usually are
+        const auto zeroStart = position;
+        while (position + sizeof(uint64_t) <= SAVE_STATE_SIZE &&
+               std::memcmp(&from[position], &to[position], sizeof(uint64_t)) == 0) {
+            position += sizeof(uint64_t);
+        }
+        while (position < SAVE_STATE_SIZE && from[position] == to[position]) {
+            position++;
+        }
+        if (position == SAVE_STATE_SIZE) {
+            break;
+        }
+
+        // The literals end at the last changed byte before a long enough run of unchanged ones
+        const auto literalStart = position;
+        auto literalEnd = position;
+        while (position < SAVE_STATE_SIZE && position - literalEnd < MIN_ZERO_RUN) {
+            if (from[position] != to[position]) {
+                literalEnd = position + 1;
+            }
+            position++;
+        }
+        position = literalEnd;
+
+        out = putVarint(out, literalStart - zeroStart);
+        out = putVarint(out, literalEnd - literalStart);
+        for (auto i = literalStart; i < literalEnd; i++) {
+            *out++ = from[i] ^ to[i];
+        }
+    }
+
+    return out;
+}
+
+// Applying a delta to either of the states it was encoded from turns it into the other one
+static void applyDelta(const uint8_t *in, const uint8_t *end, SaveState &state) {
+    std::size_t position = 0;
+
+    while (in < end) {
+        position += getVarint(in);
+        const auto literals = getVarint(in);
+        for (std::size_t i = 0; i < literals; i++) {
+            state[position++] ^= *in++;
+        }
+    }
+}
+
+Rewind::Rewind(std::size_t bufferSize, std::size_t maxSnapshots)
+        : latest_{std::make_unique<SaveState>()},
+          next_{std::make_unique<SaveState>()},
+          hasLatest_{false},
+          buffer_(bufferSize),
+          encoded_(MAX_DELTA_SIZE),
+          deltas_(maxSnapshots),
+          firstDelta_{0},
+          deltaCount_{0},
+          writeOffset_{0},
+          size_{0} {
+}
+
+void Rewind::push(const Chip8 &chip8) {
+    if (!hasLatest_) {
+        chip8.saveState(*latest_);
+        hasLatest_ = true;
+        return;
+    }
+
+    chip8.saveState(*next_);
+
+    // The delta turns the new snapshot back into the previous one, which then only needs to be kept as the delta
+    const auto size = static_cast<std::size_t>(encodeDelta(*latest_, *next_, encoded_.data()) - encoded_.data());
+    std::swap(latest_, next_);
+
+    if (size > buffer_.size() || deltas_.empty()) {
+        // The history can't be kept across a change this big
+        while (deltaCount_ > 0) {
+            dropOldest();
+        }
+        return;
+    }
+
+    if (deltaCount_ == deltas_.size()) {
+        dropOldest();
+    }
+
+    const auto offset = reserve(size);
+    std::memcpy(&buffer_[offset], encoded_.data(), size);
+    deltas_[(firstDelta_ + deltaCount_) % deltas_.size()] = {offset, size};
+    deltaCount_++;
+    writeOffset_ = offset + size;
+    size_ += size;
+}
+
+bool Rewind::pop(Chip8 &chip8) {
+    if (!hasLatest_) {
+        return false;
+    }
+
+    chip8.loadState(*latest_);
+
+    if (deltaCount_ == 0) {
+        hasLatest_ = false;
+        return true;
+    }
+
+    const auto &delta = deltas_[(firstDelta_ + deltaCount_ - 1) % deltas_.size()];
+    applyDelta(&buffer_[delta.offset], &buffer_[delta.offset] + delta.size, *latest_);
+    writeOffset_ = delta.offset;
+    size_ -= delta.size;
+    deltaCount_--;
+
+    return true;
+}
+
+void Rewind::clear() {
+    hasLatest_ = false;
+    firstDelta_ = 0;
+    deltaCount_ = 0;
+    writeOffset_ = 0;
+    size_ = 0;
+}
+
+std::size_t Rewind::snapshots() const {
+    return deltaCount_ + (hasLatest_ ? 1 : 0);
+}
+
+std::size_t Rewind::size() const {
+    return size_;
+}
+
+// Finds room for a delta after the newest one, dropping the oldest ones until it fits. Deltas never wrap around the
+// end of the buffer, so the space left at the end is skipped when a delta doesn't fit there.
+std::size_t Rewind::reserve(std::size_t size) {
+    while (deltaCount_ > 0) {
+        const auto oldestOffset = deltas_[firstDelta_].offset;
+
+        if (writeOffset_ > oldestOffset) {
+            // The deltas lie between the oldest and the write offset, so both ends of the buffer are free
+            if (writeOffset_ + size <= buffer_.size()) {
+                return writeOffset_;
+            } else if (size <= oldestOffset) {
+                return 0;
+            }
+        } else if (writeOffset_ + size <= oldestOffset) {
+            // The deltas have wrapped around, so only the space up to the oldest one is free
+            return writeOffset_;
+        }
+
+        dropOldest();
+    }
+
+    return 0;
+}
+
+void Rewind::dropOldest() {
+    size_ -= deltas_[firstDelta_].size;
+    firstDelta_ = (firstDelta_ + 1) % deltas_.size();
+    deltaCount_--;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Chip8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// History of snapshots of a machine, which can be stepped back through one snapshot at a time.
+//
+// Only the most recent snapshot is kept whole. Every older one is kept as the XOR of it and the snapshot after it, with
+// runs of zeroes (the bytes which didn't change) run-length encoded, so a snapshot usually takes a few dozen bytes.
+// The deltas are kept in a fixed-size ring buffer, and the oldest ones are dropped to make room for new ones.
+class Rewind {
+public:
+    Rewind(std::size_t bufferSize, std::size_t maxSnapshots);
+
+    void push(const Chip8 &chip8);
+
+    // Restores the most recent snapshot and forgets it, so that the next call goes back further. Returns false if
+    // there are no snapshots left.
+    bool pop(Chip8 &chip8);
+
+    void clear();
+
+    [[nodiscard]] std::size_t snapshots() const;
+
+    // Bytes taken up by the deltas
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Delta {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::size_t reserve(std::size_t size);
+
+    void dropOldest();
+
+    std::unique_ptr<SaveState> latest_;
+    std::unique_ptr<SaveState> next_;
+    bool hasLatest_;
+
+    std::vector<uint8_t> buffer_;
+    std::vector<uint8_t> encoded_; // A delta is encoded here first, as its size isn't known until then
+    std::vector<Delta> deltas_; // Ring of the deltas in buffer_, oldest first
+    std::size_t firstDelta_;
+    std::size_t deltaCount_;
+    std::size_t writeOffset_;
+    std::size_t size_;
+};
@@ -0,0 +1,33 @@
+#include "SaveState.h"
+
+#include <cerrno>
+#include <fstream>
+
+void writeStateFile(const std::string &filepath, const SaveState &state) {
+    std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        throw std::runtime_error("Can't open file: " + filepath + ". " + std::strerror(errno));
+    }
+
+    ofs.write(reinterpret_cast<const char *>(state.data()), state.size());
+    if (!ofs) {
+        throw std::runtime_error("Can't write save state to " + filepath);
+    }
+}
+
+void readStateFile(const std::string &filepath, SaveState &state) {
+    std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        throw std::runtime_error("Can't open file: " + filepath + ". " + std::strerror(errno));
+    }
+
+    if (static_cast<std::size_t>(ifs.tellg()) != state.size()) {
+        throw std::runtime_error("Save state " + filepath + " has the wrong size");
+    }
+    ifs.seekg(0, std::ios::beg);
+
+    ifs.read(reinterpret_cast<char *>(state.data()), state.size());
+    if (!ifs) {
+        throw std::runtime_error("Can't read save state from " + filepath);
+    }
+}
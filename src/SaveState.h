@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Chip8.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Save states start with this, followed by the version of their layout. The layout is described in Chip8::saveState,
+// and the version must be bumped whenever it changes.
+const std::array<uint8_t, 4> SAVE_STATE_MAGIC{'C', '8', 'S', 'T'};
+const uint16_t SAVE_STATE_VERSION = 4;
+
+// Multi-byte values are stored least significant byte first, which is how little-endian machines already hold them
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+const bool NATIVE_STATE_ORDER = true;
+#else
+const bool NATIVE_STATE_ORDER = false;
+#endif
+
+// Writes values one after another into a state, least significant byte first
+class StateWriter {
+public:
+    explicit StateWriter(SaveState &state) : data_{state.data()}, end_{state.data() + state.size()} {}
+
+    template <typename T>
+    void put(T value) {
+        for (std::size_t i = 0; i < sizeof(T); i++) {
+            *data_++ = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i));
+        }
+    }
+
+    void putBytes(const uint8_t *bytes, std::size_t count) {
+        std::memcpy(data_, bytes, count);
+        data_ += count;
+    }
+
+    // Arrays of wider values are copied in one go when the byte order allows it
+    template <typename T>
+    void putArray(const T *values, std::size_t count) {
+        if (NATIVE_STATE_ORDER) {
+            std::memcpy(data_, values, count * sizeof(T));
+            data_ += count * sizeof(T);
+        } else {
+            for (std::size_t i = 0; i < count; i++) {
+                put(values[i]);
+            }
+        }
+    }
+
+    // Every byte of the state must be written
+    [[nodiscard]] bool full() const {
+        return data_ == end_;
+    }
+
+private:
+    uint8_t *data_;
+    uint8_t *end_;
+};
+
+// Reads values back in the order StateWriter wrote them
+class StateReader {
+public:
+    explicit StateReader(const SaveState &state) : data_{state.data()} {}
+
+    template <typename T>
+    T get() {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < sizeof(T); i++) {
+            value |= static_cast<uint64_t>(*data_++) << (8 * i);
+        }
+        return static_cast<T>(value);
+    }
+
+    void getBytes(uint8_t *bytes, std::size_t count) {
+        std::memcpy(bytes, data_, count);
+        data_ += count;
+    }
+
+    template <typename T>
+    void getArray(T *values, std::size_t count) {
+        if (NATIVE_STATE_ORDER) {
+            std::memcpy(values, data_, count * sizeof(T));
+            data_ += count * sizeof(T);
+        } else {
+            for (std::size_t i = 0; i < count; i++) {
+                values[i] = get<T>();
+            }
+        }
+    }
+
+    // Current position, for fields which are compared before being copied
+    [[nodiscard]] const uint8_t *data() const {
+        return data_;
+    }
+
+    void skip(std::size_t count) {
+        data_ += count;
+    }
+
+private:
+    const uint8_t *data_;
+};
+
+void writeStateFile(const std::string &filepath, const SaveState &state);
+
+void readStateFile(const std::string &filepath, SaveState &state);
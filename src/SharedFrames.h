@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Video.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Layout of the POSIX shared memory the emulator exports its frames to with --export, for other processes to map.
+// The emulator writes every frame into the next slot of a ring, and never waits for readers. Readers read frames in
+// place, and check afterwards that the slot wasn't being overwritten while they read it.
+const std::array<uint8_t, 4> SHARED_FRAMES_MAGIC{'C', '8', 'F', 'R'};
+const uint32_t SHARED_FRAMES_VERSION = 1;
+const unsigned int SHARED_FRAME_SLOTS = 8;
+
+// Shared between processes, so the atomics must not need a lock
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+// A frame, written under a seqlock: the sequence is odd while the slot is being written, and 2 * (frame number + 1)
+// once the frame in it is complete
+struct SharedFrame {
+    std::atomic<uint64_t> sequence;
+    uint64_t frameNumber; // Frames exported before this one
+    uint64_t dirtyRows; // Rows which changed since the previous frame, one bit per row, so 0 for a repeated frame
+    uint16_t keys; // Keypad state, one bit per key
+    uint16_t width;
+    uint16_t height;
+    std::array<VideoPlane, PLANE_COUNT> planes; // As in Video, so rows and bits past the width and height are 0
+};
+
+struct SharedFrames {
+    std::array<uint8_t, 4> magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t frameSize;
+    std::atomic<uint64_t> framesWritten; // The latest frame is framesWritten - 1. Set once the header is complete.
+    std::array<SharedFrame, SHARED_FRAME_SLOTS> frames;
+};
+
+static_assert(std::is_standard_layout_v<SharedFrames>);
+
+// Starts reading a frame in place. Returns its slot, or nullptr if it isn't there because it hasn't been written yet or
+// has already been overwritten. Whatever is read from the slot is only valid if endSharedFrameRead returns true.
+inline const SharedFrame *beginSharedFrameRead(const SharedFrames &shared, uint64_t frameNumber, uint64_t &sequence) {
+    const auto &frame = shared.frames[frameNumber % SHARED_FRAME_SLOTS];
+    sequence = frame.sequence.load(std::memory_order_acquire);
+    return sequence == 2 * (frameNumber + 1) ? &frame : nullptr;
+}
+
+inline bool endSharedFrameRead(const SharedFrame &frame, uint64_t sequence) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return frame.sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,132 @@
+#include "TerminalInput.h"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+
+// Keypad key of each character, laid out like in KeyboardHandler::handle, or -1
+static int keypadKey(char c) {
+    switch (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) {
+        case '1':
+            return 0x1;
+        case '2':
+            return 0x2;
+        case '3':
+            return 0x3;
+        case '4':
+            return 0xC;
+        case 'q':
+            return 0x4;
+        case 'w':
+            return 0x5;
+        case 'e':
+            return 0x6;
+        case 'r':
+            return 0xD;
+        case 'a':
+            return 0x7;
+        case 's':
+            return 0x8;
+        case 'd':
+            return 0x9;
+        case 'f':
+            return 0xE;
+        case 'z':
+            return 0xA;
+        case 'x':
+            return 0x0;
+        case 'c':
+            return 0xB;
+        case 'v':
+            return 0xF;
+        default:
+            return -1;
+    }
+}
+
+TerminalInput::TerminalInput(KeyboardHandler &keyboardHandler)
+        : keyboardHandler_{keyboardHandler},
+          originalMode_{},
+          start_{std::chrono::steady_clock::now()},
+          heldKeys_{0},
+          releaseTimes_{} {
+
+    if (tcgetattr(STDIN_FILENO, &originalMode_) != 0) {
+        throw std::runtime_error("The terminal renderer needs stdin to be a terminal");
+    }
+
+    // Raw mode, where reads return straight away with whatever has been typed
+    termios rawMode = originalMode_;
+    rawMode.c_iflag &= ~static_cast<tcflag_t>(IXON | ICRNL);
+    rawMode.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ISIG | IEXTEN);
+    rawMode.c_cc[VMIN] = 0;
+    rawMode.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &rawMode) != 0) {
+        throw std::runtime_error("Failed to put the terminal in raw mode");
+    }
+}
+
+TerminalInput::~TerminalInput() {
+    tcsetattr(STDIN_FILENO, TCSANOW, &originalMode_);
+}
+
+bool TerminalInput::handle() {
+    const auto now = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+
+    // Released keys go first, as they were released before anything typed since
+    for (unsigned int key = 0; key < KEY_COUNT; key++) {
+        if ((heldKeys_ >> key & 1) != 0 && static_cast<int32_t>(now - releaseTimes_[key]) >= 0) {
+            keyboardHandler_.queueKey(releaseTimes_[key], key, false);
+            heldKeys_ &= static_cast<uint16_t>(~(1u << key));
+        }
+    }
+
+    bool quit = false;
+
+    char input[64];
+    ssize_t length;
+    while ((length = ::read(STDIN_FILENO, input, sizeof(input))) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            if (input[i] == 0x03) {
+                quit = true;
+            } else if (input[i] == 0x1b) {
+                // A lone escape is the escape key. Otherwise it starts the sequence of a key like an arrow key or a
+                // function key, which ends at the first letter or tilde after it.
+                if (i + 1 == length) {
+                    quit = true;
+                }
+                for (i += 2; i < length && !((input[i] >= 'A' && input[i] <= 'Z') ||
+                                             (input[i] >= 'a' && input[i] <= 'z') || input[i] == '~'); i++) {
+                }
+            } else if (const int key = keypadKey(input[i]); key >= 0) {
+                if ((heldKeys_ >> key & 1) == 0) {
+                    keyboardHandler_.queueKey(now, static_cast<unsigned int>(key), true);
+                    heldKeys_ |= static_cast<uint16_t>(1u << key);
+                }
+                releaseTimes_[key] = now + TERMINAL_KEY_HOLD_MS;
+            }
+        }
+    }
+
+    return quit;
+}
+
+#else
+
+TerminalInput::TerminalInput(KeyboardHandler &keyboardHandler)
+        : keyboardHandler_{keyboardHandler},
+          start_{std::chrono::steady_clock::now()},
+          heldKeys_{0},
+          releaseTimes_{} {
+    throw std::runtime_error("The terminal renderer isn't supported on Windows");
+}
+
+TerminalInput::~TerminalInput() = default;
+
+bool TerminalInput::handle() {
+    return true;
+}
+
+#endif
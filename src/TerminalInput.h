@@ -0,0 +1,38 @@
+#pragma once
+
+#include "KeyboardHandler.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <termios.h>
+#endif
+
+// Terminals only send the keys typed, not when they're released, so a key counts as held down for this long after the
+// last time it was typed. Holding a key down types it again and again once the terminal starts repeating it.
+const unsigned int TERMINAL_KEY_HOLD_MS = 150;
+
+// Reads the keypad from stdin in raw mode, with the same keys as KeyboardHandler::handle. Escape or Ctrl+C quits.
+class TerminalInput {
+public:
+    explicit TerminalInput(KeyboardHandler &keyboardHandler);
+
+    ~TerminalInput();
+
+    // Queues the keys typed since the last call, and the releases of the keys which are no longer held. Returns
+    // whether to quit.
+    bool handle();
+
+private:
+    KeyboardHandler &keyboardHandler_;
+
+#ifndef _WIN32
+    termios originalMode_;
+#endif
+
+    const std::chrono::steady_clock::time_point start_;
+    uint16_t heldKeys_;
+    std::array<uint32_t, KEY_COUNT> releaseTimes_;
+};
@@ -0,0 +1,225 @@
+#include "TerminalRenderer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Sends all of the output in as few writes as the terminal takes
+static void writeOutput(const std::string &output) {
+#ifndef _WIN32
+    std::size_t written = 0;
+    while (written < output.size()) {
+        const auto result = ::write(STDOUT_FILENO, output.data() + written, output.size() - written);
+        if (result < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            throw std::runtime_error("Failed to write to the terminal");
+        }
+        written += static_cast<std::size_t>(result);
+    }
+#else
+    std::fwrite(output.data(), 1, output.size(), stdout);
+    std::fflush(stdout);
+#endif
+}
+
+std::string StatusLine::latest() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return latest_;
+}
+
+StatusLine::int_type StatusLine::overflow(int_type c) {
+    if (c != traits_type::eof()) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        put(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize StatusLine::xsputn(const char *s, std::streamsize count) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (std::streamsize i = 0; i < count; i++) {
+        put(s[i]);
+    }
+    return count;
+}
+
+void StatusLine::put(char c) {
+    if (c == '\n') {
+        latest_ = line_;
+        line_.clear();
+    } else if (c >= ' ') {
+        line_ += c;
+    }
+}
+
+TerminalRenderer::TerminalRenderer(unsigned int maxFrameRate, const Palette &palette)
+        : palette_{palette},
+          terminalColours_{palette[0] == PALETTE[0] && palette[1] == PALETTE[1]},
+          cells_{},
+          shownCells_{},
+          columns_{0},
+          rows_{0},
+          shownColumns_{0},
+          shownRows_{0},
+          presentPending_{false},
+          cursorRow_{0},
+          cursorColumn_{0},
+          colours_{DEFAULT_COLOURS},
+          presentInterval_{std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(1.0 / std::max(1u, maxFrameRate)))},
+          lastPresent_{},
+          output_{},
+          statusLine_{},
+          shownStatus_{},
+          coutBuffer_{std::cout.rdbuf(&statusLine_)},
+          cerrBuffer_{std::cerr.rdbuf(&statusLine_)} {
+
+    // Switch to the alternate screen and hide the cursor, so that the terminal is left as it was afterwards
+    writeOutput("\x1b[?1049h\x1b[?25l\x1b[2J");
+}
+
+TerminalRenderer::~TerminalRenderer() {
+    std::cout.rdbuf(coutBuffer_);
+    std::cerr.rdbuf(cerrBuffer_);
+
+    try {
+        writeOutput("\x1b[0m\x1b[?25h\x1b[?1049l");
+    }
+    catch (const std::exception &) {
+        // Nothing can be done about the terminal by now
+    }
+}
+
+void TerminalRenderer::update(const Video &video, uint64_t dirtyRows) {
+    columns_ = video.width;
+    rows_ = video.height / 2;
+
+    // A cell row covers two rows of pixels, so it's dirty when either of them is
+    uint64_t dirtyCellRows = 0;
+    for (auto rows = dirtyRows & allRows(video.height); rows != 0; rows &= rows - 1) {
+        dirtyCellRows |= uint64_t{1} << (__builtin_ctzll(rows) / 2);
+    }
+
+    for (auto rows = dirtyCellRows; rows != 0; rows &= rows - 1) {
+        const auto row = static_cast<unsigned int>(__builtin_ctzll(rows));
+
+        for (unsigned int x = 0; x < columns_; x++) {
+            unsigned int top = 0;
+            unsigned int bottom = 0;
+            for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                const auto shift = 63 - x % 64;
+                top |= static_cast<unsigned int>(video.planes[plane][row * 2][x / 64] >> shift & 1) << plane;
+                bottom |= static_cast<unsigned int>(video.planes[plane][row * 2 + 1][x / 64] >> shift & 1) << plane;
+            }
+            cells_[row * MAX_COLUMNS + x] = static_cast<uint8_t>(top | bottom << 4);
+        }
+    }
+
+    if (dirtyCellRows != 0) {
+        presentPending_ = true;
+    }
+}
+
+void TerminalRenderer::present() {
+    auto status = statusLine_.latest();
+    const bool statusChanged = status != shownStatus_;
+    if (!presentPending_ && !statusChanged) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastPresent_ < presentInterval_) {
+        return;
+    }
+    lastPresent_ = now;
+
+    output_.clear();
+
+    // The terminal shows empty cells after being cleared, so only the cells with something in them need sending. When
+    // empty cells aren't left to the terminal's colours, they have to be drawn too.
+    const bool resized = columns_ != shownColumns_ || rows_ != shownRows_;
+    if (resized) {
+        output_ += "\x1b[0m\x1b[2J";
+        colours_ = DEFAULT_COLOURS;
+        shownCells_.fill(terminalColours_ ? 0 : UNSHOWN_CELL);
+        shownColumns_ = columns_;
+        shownRows_ = rows_;
+        cursorRow_ = MAX_ROWS + 1;
+    }
+
+    for (unsigned int row = 0; row < rows_; row++) {
+        for (unsigned int column = 0; column < columns_; column++) {
+            const auto index = row * MAX_COLUMNS + column;
+            if (cells_[index] != shownCells_[index]) {
+                // Moving the cursor over a cell or two takes more bytes than sending them again
+                if (row == cursorRow_ && column > cursorColumn_ && column - cursorColumn_ <= 2) {
+                    for (auto skipped = cursorColumn_; skipped < column; skipped++) {
+                        appendCell(row, skipped, cells_[row * MAX_COLUMNS + skipped]);
+                    }
+                }
+                appendCell(row, column, cells_[index]);
+                shownCells_[index] = cells_[index];
+            }
+        }
+    }
+
+    if (colours_ != DEFAULT_COLOURS) {
+        output_ += "\x1b[0m";
+        colours_ = DEFAULT_COLOURS;
+    }
+
+    if (statusChanged || resized) {
+        if (status.size() > columns_) {
+            status.resize(columns_);
+        }
+        output_ += "\x1b[" + std::to_string(rows_ + 2) + ";1H\x1b[2K" + status;
+        cursorRow_ = MAX_ROWS + 1;
+        shownStatus_ = status;
+    }
+
+    if (!output_.empty()) {
+        writeOutput(output_);
+    }
+    presentPending_ = false;
+}
+
+void TerminalRenderer::appendCell(unsigned int row, unsigned int column, uint8_t cell) {
+    if (row != cursorRow_ || column != cursorColumn_) {
+        output_ += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(column + 1) + "H";
+    }
+
+    const unsigned int top = cell & 0xF;
+    const unsigned int bottom = cell >> 4;
+
+    // Pixels which are only on in the first plane are drawn in the terminal's own colours, with glyphs alone
+    if (terminalColours_ && top <= 1 && bottom <= 1) {
+        if (colours_ != DEFAULT_COLOURS) {
+            output_ += "\x1b[0m";
+            colours_ = DEFAULT_COLOURS;
+        }
+        static const char *const GLYPHS[4] = {" ", "▀", "▄", "█"};
+        output_ += GLYPHS[top | bottom << 1];
+    } else {
+        if (colours_ != cell) {
+            const auto component = [](uint32_t colour, unsigned int shift) {
+                return std::to_string(colour >> shift & 0xFF);
+            };
+            output_ += "\x1b[38;2;" + component(palette_[top], 24) + ";" + component(palette_[top], 16) + ";" +
+                       component(palette_[top], 8) + ";48;2;" + component(palette_[bottom], 24) + ";" +
+                       component(palette_[bottom], 16) + ";" + component(palette_[bottom], 8) + "m";
+            colours_ = cell;
+        }
+        output_ += "▀";
+    }
+
+    cursorRow_ = row;
+    cursorColumn_ = column + 1;
+}
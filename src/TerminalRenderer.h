@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Video.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+// Collects what is printed while the terminal shows the screen, so that the latest line can be shown under the screen
+// instead of scrolling it away. Lines can be printed from any thread.
+class StatusLine : public std::streambuf {
+public:
+    // The last complete line printed
+    [[nodiscard]] std::string latest() const;
+
+protected:
+    int_type overflow(int_type c) override;
+
+    std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+private:
+    void put(char c);
+
+    mutable std::mutex mutex_;
+    std::string line_;
+    std::string latest_;
+};
+
+// Draws the screen in the terminal, for watching the emulator over SSH. Every character cell shows two pixels stacked
+// on top of each other with Unicode half blocks, in the default colours of the terminal when only the first plane is
+// used and the palette keeps the default colours for it, and in 24 bit colour otherwise. Only the cells which changed
+// since the last present are sent, all in one write.
+class TerminalRenderer {
+public:
+    // Presents at most maxFrameRate times per second
+    explicit TerminalRenderer(unsigned int maxFrameRate, const Palette &palette = PALETTE);
+
+    ~TerminalRenderer();
+
+    // Works out the cells of the dirty rows. Only the latest update before a present is shown.
+    void update(const Video &video, uint64_t dirtyRows);
+
+    // Sends the cells which changed since the last present, unless it's too soon after it
+    void present();
+
+private:
+    // Cells are the palette indices of the top and bottom pixels, with the top one in the low 4 bits
+    static const unsigned int MAX_COLUMNS = HIRES_VIDEO_WIDTH;
+    static const unsigned int MAX_ROWS = HIRES_VIDEO_HEIGHT / 2;
+    static const int DEFAULT_COLOURS = -1;
+    static const uint16_t UNSHOWN_CELL = 0x100; // Not a cell, so it's never taken as already on screen
+
+    void appendCell(unsigned int row, unsigned int column, uint8_t cell);
+
+    const Palette palette_;
+    const bool terminalColours_; // Whether pixels of the first plane are left to the terminal's own colours
+
+    std::array<uint8_t, MAX_COLUMNS * MAX_ROWS> cells_;
+    std::array<uint16_t, MAX_COLUMNS * MAX_ROWS> shownCells_;
+    unsigned int columns_;
+    unsigned int rows_;
+    unsigned int shownColumns_;
+    unsigned int shownRows_;
+    bool presentPending_;
+
+    // Position and colours the terminal is at, to leave out escape sequences which wouldn't change them
+    unsigned int cursorRow_;
+    unsigned int cursorColumn_;
+    int colours_;
+
+    const std::chrono::steady_clock::duration presentInterval_;
+    std::chrono::steady_clock::time_point lastPresent_;
+
+    std::string output_; // Everything sent by a present, reused so that it doesn't have to grow every time
+
+    StatusLine statusLine_;
+    std::string shownStatus_;
+    std::streambuf *coutBuffer_;
+    std::streambuf *cerrBuffer_;
+};
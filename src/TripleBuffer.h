@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands values from one writer thread to one reader thread without either ever waiting for the other. The writer
+// fills one buffer while the reader holds another, and the third holds the newest value the writer published. Each
+// side swaps its buffer with the third one, so the reader always gets the newest value, and values published faster
+// than they're read are dropped.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : buffers_{}, writeIndex_{0}, shared_{1}, readIndex_{2}, dropped_{0}, emptyUpdates_{0} {}
+
+    // Only used by the writer
+    T &writeBuffer() {
+        return buffers_[writeIndex_];
+    }
+
+    // Returns true if the value published before this one was dropped without the reader ever seeing it
+    bool publish() {
+        const auto previous = shared_.exchange(static_cast<uint8_t>(writeIndex_ | FRESH), std::memory_order_acq_rel);
+        writeIndex_ = previous & INDEX_MASK;
+
+        const bool dropped = (previous & FRESH) != 0;
+        if (dropped) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+
+    // Only used by the reader. Takes the newest published value, and returns false if there's none since the last
+    // call, in which case the read buffer still holds the value from before.
+    bool update() {
+        if ((shared_.load(std::memory_order_relaxed) & FRESH) == 0) {
+            emptyUpdates_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        readIndex_ = shared_.exchange(readIndex_, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T &readBuffer() const {
+        return buffers_[readIndex_];
+    }
+
+    // Values which were replaced before the reader got to them
+    [[nodiscard]] unsigned long dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    // Calls to update which found no new value. The reader polls once per refresh, so for frames this counts refreshes
+    // with nothing new to show, whether the writer fell behind or simply had nothing to publish. It's not the number
+    // of frames shown twice: a reader which finds nothing new doesn't have to show anything.
+    [[nodiscard]] unsigned long emptyUpdates() const {
+        return emptyUpdates_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4; // Set in shared_ when it holds a value the reader hasn't taken
+
+    std::array<T, 3> buffers_;
+    uint8_t writeIndex_;
+    std::atomic<uint8_t> shared_;
+    uint8_t readIndex_;
+
+    std::atomic<unsigned long> dropped_;
+    std::atomic<unsigned long> emptyUpdates_;
+};
@@ -0,0 +1,376 @@
+#include "Upscale.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Widest row a filter produces, before nearest neighbour scaling
+static const unsigned int MAX_FILTERED_WIDTH = HIRES_VIDEO_WIDTH * 3;
+
+// Rows of the screen with a copy of the edge pixel on either side, so that every pixel has a left and right neighbour
+using PaddedRow = std::array<uint8_t, HIRES_VIDEO_WIDTH + 2>;
+
+// With room for the 2 bytes interleave3 writes past the end of a row
+using FilteredRow = std::array<uint8_t, MAX_FILTERED_WIDTH + 2>;
+
+void indexVideoRows(const Video &video, unsigned int firstRow, unsigned int endRow, VideoIndices &indices) {
+    for (unsigned int y = firstRow; y < endRow; y++) {
+        auto *out = indices.data() + y * HIRES_VIDEO_WIDTH;
+
+        for (unsigned int word = 0; word < video.width / 64; word++) {
+            std::array<uint64_t, PLANE_COUNT> bits;
+            for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                bits[plane] = video.planes[plane][y][word];
+            }
+
+            for (unsigned int x = 0; x < 64; x++) {
+                unsigned int colour = 0;
+                for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                    colour |= static_cast<unsigned int>(bits[plane] >> (63 - x) & 1) << plane;
+                }
+                out[word * 64 + x] = static_cast<uint8_t>(colour);
+            }
+        }
+    }
+}
+
+unsigned int filterFactor(Filter filter) {
+    switch (filter) {
+        case Filter::SCALE2X:
+            return 2;
+        case Filter::SCALE3X:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+unsigned int filterScale(Filter filter, unsigned int width, unsigned int height, unsigned int areaWidth,
+                         unsigned int areaHeight) {
+    const auto factor = filterFactor(filter);
+    const auto scale = std::min(areaWidth / width, areaHeight / height) / factor * factor;
+    return std::max(scale, factor);
+}
+
+static void padRow(const VideoIndices &indices, unsigned int width, unsigned int y, PaddedRow &row) {
+    const auto *source = indices.data() + y * HIRES_VIDEO_WIDTH;
+    std::memcpy(row.data() + 1, source, width);
+    row[0] = source[0];
+    row[width + 1] = source[width - 1];
+}
+
+// Scale2x turns each pixel E into 2x2 pixels, from E and its neighbours B above, D to the left, F to the right and H
+// below. Corners between two matching neighbours take their colour, which rounds off diagonal edges.
+template <bool Simd>
+static void scale2xRows(const PaddedRow &up, const PaddedRow &row, const PaddedRow &down, unsigned int width,
+                        FilteredRow &top, FilteredRow &bottom) {
+    unsigned int x = 0;
+
+#if defined(__SSE2__)
+    if (Simd) {
+        const auto load = [](const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+        const auto pick = [](__m128i mask, __m128i a, __m128i b) {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        };
+
+        // Widths are multiples of 64, so whole vectors of 16 pixels always fit
+        for (; x < width; x += 16) {
+            const auto b = load(up.data() + x + 1);
+            const auto d = load(row.data() + x);
+            const auto e = load(row.data() + x + 1);
+            const auto f = load(row.data() + x + 2);
+            const auto h = load(down.data() + x + 1);
+
+            const auto db = _mm_cmpeq_epi8(d, b);
+            const auto bf = _mm_cmpeq_epi8(b, f);
+            const auto dh = _mm_cmpeq_epi8(d, h);
+            const auto hf = _mm_cmpeq_epi8(h, f);
+
+            const auto e0 = pick(_mm_andnot_si128(_mm_or_si128(bf, dh), db), d, e);
+            const auto e1 = pick(_mm_andnot_si128(_mm_or_si128(db, hf), bf), f, e);
+            const auto e2 = pick(_mm_andnot_si128(_mm_or_si128(db, hf), dh), d, e);
+            const auto e3 = pick(_mm_andnot_si128(_mm_or_si128(dh, bf), hf), f, e);
+
+            auto *outTop = reinterpret_cast<__m128i *>(top.data() + 2 * x);
+            auto *outBottom = reinterpret_cast<__m128i *>(bottom.data() + 2 * x);
+            _mm_storeu_si128(outTop, _mm_unpacklo_epi8(e0, e1));
+            _mm_storeu_si128(outTop + 1, _mm_unpackhi_epi8(e0, e1));
+            _mm_storeu_si128(outBottom, _mm_unpacklo_epi8(e2, e3));
+            _mm_storeu_si128(outBottom + 1, _mm_unpackhi_epi8(e2, e3));
+        }
+    }
+#endif
+
+    for (; x < width; x++) {
+        const auto b = up[x + 1];
+        const auto d = row[x];
+        const auto e = row[x + 1];
+        const auto f = row[x + 2];
+        const auto h = down[x + 1];
+
+        top[2 * x] = d == b && b != f && d != h ? d : e;
+        top[2 * x + 1] = b == f && b != d && f != h ? f : e;
+        bottom[2 * x] = d == h && d != b && h != f ? d : e;
+        bottom[2 * x + 1] = h == f && d != h && b != f ? f : e;
+    }
+}
+
+#if defined(__SSE2__)
+// Interleaves 16 pixels from each of three vectors into 48 bytes. SSE2 can't shuffle bytes three ways, so the three
+// pixels of each column are widened into a 32 bit lane, pairs of lanes are packed into 6 bytes of a 64 bit lane, and
+// those are written 6 bytes apart, each overwriting the 2 unused bytes of the one before. The last write runs 2 bytes
+// past the end.
+static void interleave3(__m128i first, __m128i second, __m128i third, uint8_t *out) {
+    const auto zero = _mm_setzero_si128();
+    const auto low = _mm_unpacklo_epi8(first, second);
+    const auto high = _mm_unpackhi_epi8(first, second);
+    const auto thirdLow = _mm_unpacklo_epi8(third, zero);
+    const auto thirdHigh = _mm_unpackhi_epi8(third, zero);
+    const auto lowLane = _mm_set1_epi64x(0xFFFFFF);
+    const auto highLane = _mm_set1_epi64x(0xFFFFFF000000);
+    const auto pack = [&lowLane, &highLane](__m128i lanes) {
+        return _mm_or_si128(_mm_and_si128(lanes, lowLane), _mm_and_si128(_mm_srli_epi64(lanes, 8), highLane));
+    };
+
+    const __m128i packed[4]{pack(_mm_unpacklo_epi16(low, thirdLow)), pack(_mm_unpackhi_epi16(low, thirdLow)),
+                            pack(_mm_unpacklo_epi16(high, thirdHigh)), pack(_mm_unpackhi_epi16(high, thirdHigh))};
+    for (unsigned int n = 0; n < 4; n++) {
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 12 * n), packed[n]);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 12 * n + 6), _mm_unpackhi_epi64(packed[n], packed[n]));
+    }
+}
+#endif
+
+// Scale3x turns each pixel E into 3x3 pixels, from E and all 8 of its neighbours:
+//   A B C
+//   D E F
+//   G H I
+template <bool Simd>
+static void scale3xRows(const PaddedRow &up, const PaddedRow &row, const PaddedRow &down, unsigned int width,
+                        FilteredRow &top, FilteredRow &middle, FilteredRow &bottom) {
+    unsigned int x = 0;
+
+#if defined(__SSE2__)
+    if (Simd) {
+        const auto load = [](const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+        const auto pick = [](__m128i mask, __m128i a, __m128i b) {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        };
+        const auto ones = _mm_set1_epi8(-1);
+
+        for (; x < width; x += 16) {
+            const auto a = load(up.data() + x);
+            const auto b = load(up.data() + x + 1);
+            const auto c = load(up.data() + x + 2);
+            const auto d = load(row.data() + x);
+            const auto e = load(row.data() + x + 1);
+            const auto f = load(row.data() + x + 2);
+            const auto g = load(down.data() + x);
+            const auto h = load(down.data() + x + 1);
+            const auto i = load(down.data() + x + 2);
+
+            const auto db = _mm_cmpeq_epi8(d, b);
+            const auto bf = _mm_cmpeq_epi8(b, f);
+            const auto dh = _mm_cmpeq_epi8(d, h);
+            const auto hf = _mm_cmpeq_epi8(h, f);
+            const auto notEa = _mm_xor_si128(_mm_cmpeq_epi8(e, a), ones);
+            const auto notEc = _mm_xor_si128(_mm_cmpeq_epi8(e, c), ones);
+            const auto notEg = _mm_xor_si128(_mm_cmpeq_epi8(e, g), ones);
+            const auto notEi = _mm_xor_si128(_mm_cmpeq_epi8(e, i), ones);
+
+            // The four corner conditions of Scale2x, which the edges of Scale3x combine
+            const auto cornerDb = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+            const auto cornerBf = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+            const auto cornerDh = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+            const auto cornerHf = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+
+            interleave3(pick(cornerDb, d, e),
+                        pick(_mm_or_si128(_mm_and_si128(cornerDb, notEc), _mm_and_si128(cornerBf, notEa)), b, e),
+                        pick(cornerBf, f, e), top.data() + 3 * x);
+            interleave3(pick(_mm_or_si128(_mm_and_si128(cornerDb, notEg), _mm_and_si128(cornerDh, notEa)), d, e), e,
+                        pick(_mm_or_si128(_mm_and_si128(cornerBf, notEi), _mm_and_si128(cornerHf, notEc)), f, e),
+                        middle.data() + 3 * x);
+            interleave3(pick(cornerDh, d, e),
+                        pick(_mm_or_si128(_mm_and_si128(cornerDh, notEi), _mm_and_si128(cornerHf, notEg)), h, e),
+                        pick(cornerHf, f, e), bottom.data() + 3 * x);
+        }
+    }
+#endif
+
+    for (; x < width; x++) {
+        const auto a = up[x];
+        const auto b = up[x + 1];
+        const auto c = up[x + 2];
+        const auto d = row[x];
+        const auto e = row[x + 1];
+        const auto f = row[x + 2];
+        const auto g = down[x];
+        const auto h = down[x + 1];
+        const auto i = down[x + 2];
+
+        const bool cornerDb = d == b && b != f && d != h;
+        const bool cornerBf = b == f && b != d && f != h;
+        const bool cornerDh = d == h && d != b && h != f;
+        const bool cornerHf = h == f && d != h && b != f;
+
+        const auto column = 3 * x;
+        top[column] = cornerDb ? d : e;
+        top[column + 1] = (cornerDb && e != c) || (cornerBf && e != a) ? b : e;
+        top[column + 2] = cornerBf ? f : e;
+        middle[column] = (cornerDb && e != g) || (cornerDh && e != a) ? d : e;
+        middle[column + 1] = e;
+        middle[column + 2] = (cornerBf && e != i) || (cornerHf && e != c) ? f : e;
+        bottom[column] = cornerDh ? d : e;
+        bottom[column + 1] = (cornerDh && e != i) || (cornerHf && e != g) ? h : e;
+        bottom[column + 2] = cornerHf ? f : e;
+    }
+}
+
+// Looks up the colour of each of count pixels and repeats it repeat times
+template <bool Simd>
+static void expandRow(const uint8_t *indices, unsigned int count, unsigned int repeat, const Palette &palette,
+                      uint32_t *out) {
+#if defined(__SSE2__)
+    // Blocks of 4 or more pixels are filled 4 at a time, with the last store overlapping the one before it rather than
+    // running into the next block
+    if (Simd && repeat >= 4) {
+        for (unsigned int i = 0; i < count; i++) {
+            const auto colour = _mm_set1_epi32(static_cast<int>(palette[indices[i]]));
+            auto *block = out + i * repeat;
+            for (unsigned int j = 0; j + 4 < repeat; j += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(block + j), colour);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(block + repeat - 4), colour);
+        }
+        return;
+    }
+#endif
+
+    for (unsigned int i = 0; i < count; i++) {
+        const auto colour = palette[indices[i]];
+        for (unsigned int j = 0; j < repeat; j++) {
+            out[i * repeat + j] = colour;
+        }
+    }
+}
+
+// Halves the red, green and blue of each pixel, keeping alpha
+template <bool Simd>
+static void darkenRow(const uint32_t *in, unsigned int count, uint32_t *out) {
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    if (Simd) {
+        const auto colourMask = _mm_set1_epi32(0x7F7F7F00);
+        const auto alphaMask = _mm_set1_epi32(0xFF);
+        for (; i + 4 <= count; i += 4) {
+            const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            const auto darker = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 1), colourMask),
+                                             _mm_and_si128(pixels, alphaMask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), darker);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = ((in[i] >> 1) & 0x7F7F7F00) | (in[i] & 0xFF);
+    }
+}
+
+// Copies a finished row into the output. The output is written once and not read again, so with SSE2 it's written
+// around the cache, which also saves reading each line in before it's overwritten.
+template <bool Simd>
+static void copyRow(const uint32_t *in, unsigned int count, uint32_t *out) {
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    if (Simd) {
+        for (; i < count && reinterpret_cast<uintptr_t>(out + i) % 16 != 0; i++) {
+            out[i] = in[i];
+        }
+        for (; i + 4 <= count; i += 4) {
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + i),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+        }
+    }
+#endif
+
+    std::memcpy(out + i, in + i, (count - i) * sizeof(uint32_t));
+}
+
+template <bool Simd>
+static void upscale(Filter filter, const VideoIndices &indices, unsigned int width, unsigned int height,
+                    unsigned int firstRow, unsigned int endRow, unsigned int scale, const Palette &palette,
+                    uint32_t *pixels, std::size_t pitch) {
+    const auto factor = filterFactor(filter);
+    const auto repeat = scale / factor;
+    const auto outWidth = width * scale;
+
+    // Each filtered row is expanded once, and copied into the rest of the rows it's scaled to. Scanlines only darken
+    // rows of the window, so they need a scale of at least 2 to leave anything bright.
+    const bool scanlines = filter == Filter::SCANLINES && scale >= 2;
+    std::vector<uint32_t> rows(2 * static_cast<std::size_t>(outWidth));
+    auto *brightRow = rows.data();
+    auto *darkRow = rows.data() + outWidth;
+
+    std::array<FilteredRow, 3> filtered;
+    std::array<PaddedRow, 3> padded;
+
+    for (unsigned int y = firstRow; y < endRow; y++) {
+        std::array<const uint8_t *, 3> sources{};
+        if (factor == 1) {
+            sources[0] = indices.data() + y * HIRES_VIDEO_WIDTH;
+        } else {
+            // Rows past the top and bottom edges repeat the edge row
+            padRow(indices, width, y == 0 ? 0 : y - 1, padded[0]);
+            padRow(indices, width, y, padded[1]);
+            padRow(indices, width, y + 1 == height ? y : y + 1, padded[2]);
+
+            if (factor == 2) {
+                scale2xRows<Simd>(padded[0], padded[1], padded[2], width, filtered[0], filtered[1]);
+            } else {
+                scale3xRows<Simd>(padded[0], padded[1], padded[2], width, filtered[0], filtered[1], filtered[2]);
+            }
+            for (unsigned int k = 0; k < factor; k++) {
+                sources[k] = filtered[k].data();
+            }
+        }
+
+        for (unsigned int k = 0; k < factor; k++) {
+            expandRow<Simd>(sources[k], width * factor, repeat, palette, brightRow);
+            if (scanlines) {
+                darkenRow<Simd>(brightRow, outWidth, darkRow);
+            }
+
+            for (unsigned int j = 0; j < repeat; j++) {
+                const auto outRow = (y - firstRow) * scale + k * repeat + j;
+                const auto globalRow = y * scale + k * repeat + j;
+                const auto *row = scanlines && globalRow % 2 == 1 ? darkRow : brightRow;
+                copyRow<Simd>(row, outWidth, pixels + outRow * pitch);
+            }
+        }
+    }
+
+#if defined(__SSE2__)
+    if (Simd) {
+        // Makes the streamed stores visible before the pixels are handed on
+        _mm_sfence();
+    }
+#endif
+}
+
+void upscaleRows(Filter filter, const VideoIndices &indices, unsigned int width, unsigned int height,
+                 unsigned int firstRow, unsigned int endRow, unsigned int scale, const Palette &palette,
+                 uint32_t *pixels, std::size_t pitch) {
+    upscale<true>(filter, indices, width, height, firstRow, endRow, scale, palette, pixels, pitch);
+}
+
+void upscaleRowsReference(Filter filter, const VideoIndices &indices, unsigned int width, unsigned int height,
+                          unsigned int firstRow, unsigned int endRow, unsigned int scale, const Palette &palette,
+                          uint32_t *pixels, std::size_t pitch) {
+    upscale<false>(filter, indices, width, height, firstRow, endRow, scale, palette, pixels, pitch);
+}
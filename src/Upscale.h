@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Filter.h"
+#include "Video.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// The screen with one palette index per pixel, which is what the filters compare. Rows are HIRES_VIDEO_WIDTH apart.
+using VideoIndices = std::array<uint8_t, HIRES_VIDEO_WIDTH * HIRES_VIDEO_HEIGHT>;
+
+// Stores the palette index of every pixel of rows firstRow up to endRow
+void indexVideoRows(const Video &video, unsigned int firstRow, unsigned int endRow, VideoIndices &indices);
+
+// Scale which the filter itself produces. Nearest neighbour scaling makes up the rest.
+unsigned int filterFactor(Filter filter);
+
+// Largest scale which fits a screen of the given size into the area, which is a multiple of the factor of the filter
+// and at least the factor
+unsigned int filterScale(Filter filter, unsigned int width, unsigned int height, unsigned int areaWidth,
+                         unsigned int areaHeight);
+
+// Filters rows firstRow up to endRow of a screen of the given size and scales them by scale, into RGBA8888 values
+// starting at pixels with rows pitch pixels apart. Each source row becomes scale rows. Rows just outside the range
+// are read by Scale2x and Scale3x, so they must be indexed too.
+void upscaleRows(Filter filter, const VideoIndices &indices, unsigned int width, unsigned int height,
+                 unsigned int firstRow, unsigned int endRow, unsigned int scale, const Palette &palette,
+                 uint32_t *pixels, std::size_t pitch);
+
+// The same without SIMD, which the SIMD kernels are checked against
+void upscaleRowsReference(Filter filter, const VideoIndices &indices, unsigned int width, unsigned int height,
+                          unsigned int firstRow, unsigned int endRow, unsigned int scale, const Palette &palette,
+                          uint32_t *pixels, std::size_t pitch);
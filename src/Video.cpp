@@ -0,0 +1,25 @@
+#include "Video.h"
+
+// The inner loops have fixed trip counts and no branches, so compilers can unroll and vectorise them
+void expandVideoRows(const Video &video, unsigned int firstRow, unsigned int endRow, uint32_t *pixels,
+                     std::size_t pitch, const Palette &palette) {
+    for (unsigned int y = firstRow; y < endRow; y++) {
+        auto *out = pixels + (y - firstRow) * pitch;
+
+        for (unsigned int word = 0; word < video.width / 64; word++) {
+            std::array<uint64_t, PLANE_COUNT> bits;
+            for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                bits[plane] = video.planes[plane][y][word];
+            }
+
+            for (unsigned int x = 0; x < 64; x++) {
+                // Gather the bit of each plane into an index into the palette
+                unsigned int colour = 0;
+                for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                    colour |= static_cast<unsigned int>(bits[plane] >> (63 - x) & 1) << plane;
+                }
+                out[word * 64 + x] = palette[colour];
+            }
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Constants.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// The SCHIP high resolution mode doubles both dimensions
+const unsigned int HIRES_VIDEO_WIDTH = VIDEO_WIDTH * 2;
+const unsigned int HIRES_VIDEO_HEIGHT = VIDEO_HEIGHT * 2;
+
+const unsigned int VIDEO_ROW_WORDS = HIRES_VIDEO_WIDTH / 64;
+
+// One row of the screen with one bit per pixel. The most significant bit of the first word is the leftmost pixel.
+using VideoRow = std::array<uint64_t, VIDEO_ROW_WORDS>;
+
+// The XO-CHIP draws to up to 4 bitplanes. The colour of a pixel is picked by its bits in every plane together.
+const unsigned int PLANE_COUNT = 4;
+
+using VideoPlane = std::array<VideoRow, HIRES_VIDEO_HEIGHT>;
+
+// The screen at its current resolution. Rows and bits past the current width and height are always 0.
+struct Video {
+    unsigned int width;
+    unsigned int height;
+    std::array<VideoPlane, PLANE_COUNT> planes;
+
+    bool operator==(const Video &other) const {
+        return width == other.width && height == other.height && planes == other.planes;
+    }
+
+    bool operator!=(const Video &other) const {
+        return !(*this == other);
+    }
+};
+
+// The screen with one RGBA8888 value per pixel, as uploaded by the renderer. Rows are width pixels apart.
+using VideoPixels = std::array<uint32_t, HIRES_VIDEO_WIDTH * HIRES_VIDEO_HEIGHT>;
+
+const uint32_t PIXEL_ON = 0xFFFFFFFF;
+const uint32_t PIXEL_OFF = 0x00000000;
+
+// Colour of each combination of planes, indexed by the bits of the planes with plane 0 as the lowest bit. A screen
+// which only uses plane 0 looks the same as before the XO-CHIP planes were added.
+using Palette = std::array<uint32_t, 1 << PLANE_COUNT>;
+
+const Palette PALETTE{
+        PIXEL_OFF, PIXEL_ON, 0xAAAAAAFF, 0x555555FF,
+        0xFF0000FF, 0x00FF00FF, 0x0000FFFF, 0xFFFF00FF,
+        0x880000FF, 0x008800FF, 0x000088FF, 0x888800FF,
+        0xFF00FFFF, 0x00FFFFFF, 0x880088FF, 0x008888FF
+};
+
+// Expands rows firstRow up to endRow of the screen into one RGBA8888 value per pixel, starting at pixels with rows
+// pitch pixels apart
+void expandVideoRows(const Video &video, unsigned int firstRow, unsigned int endRow, uint32_t *pixels,
+                     std::size_t pitch, const Palette &palette = PALETTE);
+
+inline void expandVideo(const Video &video, uint32_t *pixels, std::size_t pitch) {
+    expandVideoRows(video, 0, video.height, pixels, pitch);
+}
+
+inline void expandVideo(const Video &video, VideoPixels &pixels) {
+    expandVideo(video, pixels.data(), video.width);
+}
+
+// Dirty rows are tracked with one bit per row
+static_assert(HIRES_VIDEO_HEIGHT <= 64);
+
+// Bits of all the rows on screen at the given height
+inline uint64_t allRows(unsigned int height) {
+    return height >= 64 ? ~uint64_t{0} : (uint64_t{1} << height) - 1;
+}
+
+// Moves the pixels of a row right (towards higher x) or left by the given number of pixels, filling in with 0
+inline VideoRow shiftRowRight(const VideoRow &row, unsigned int pixels) {
+    if (pixels == 0) {
+        return row;
+    } else if (pixels >= 128) {
+        return {0, 0};
+    } else if (pixels >= 64) {
+        return {0, row[0] >> (pixels - 64)};
+    }
+    return {row[0] >> pixels, (row[1] >> pixels) | (row[0] << (64 - pixels))};
+}
+
+inline VideoRow shiftRowLeft(const VideoRow &row, unsigned int pixels) {
+    if (pixels == 0) {
+        return row;
+    } else if (pixels >= 128) {
+        return {0, 0};
+    } else if (pixels >= 64) {
+        return {row[1] << (pixels - 64), 0};
+    }
+    return {(row[0] << pixels) | (row[1] >> (64 - pixels)), row[1] << pixels};
+}
+
+// Bits of a row which are on screen at the given width
+inline VideoRow rowMask(unsigned int width) {
+    return width > 64 ? VideoRow{~uint64_t{0}, ~uint64_t{0}} : VideoRow{~uint64_t{0}, 0};
+}
@@ -0,0 +1,179 @@
+#include "VideoCapture.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+VideoCapture::VideoCapture(const std::string &path, CaptureFormat format, bool skipDuplicates, const Palette &palette)
+        : out_{&std::cout},
+          format_{format},
+          skipDuplicates_{skipDuplicates},
+          colours_{},
+          previous_{},
+          frame_(CAPTURE_WIDTH * CAPTURE_HEIGHT * 3),
+          heldFrames_{0},
+          buffer_(CAPTURE_BUFFER_SIZE),
+          buffered_{0},
+          framesAdded_{0},
+          framesWritten_{0} {
+
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    } else {
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            throw std::runtime_error("Can't open file: " + path + ". " + std::strerror(errno));
+        }
+        out_ = &file_;
+    }
+
+    for (std::size_t i = 0; i < colours_.size(); i++) {
+        const double r = (palette[i] >> 24 & 0xFF) / 255.0;
+        const double g = (palette[i] >> 16 & 0xFF) / 255.0;
+        const double b = (palette[i] >> 8 & 0xFF) / 255.0;
+
+        if (format_ == CaptureFormat::Y4M) {
+            // BT.601 in the limited range, which is what Y4M readers assume when the stream doesn't say otherwise
+            colours_[i] = {static_cast<uint8_t>(16 + 65.481 * r + 128.553 * g + 24.966 * b + 0.5),
+                           static_cast<uint8_t>(128 - 37.797 * r - 74.203 * g + 112.0 * b + 0.5),
+                           static_cast<uint8_t>(128 + 112.0 * r - 93.786 * g - 18.214 * b + 0.5)};
+        } else {
+            colours_[i] = {static_cast<uint8_t>(palette[i] >> 24), static_cast<uint8_t>(palette[i] >> 16),
+                           static_cast<uint8_t>(palette[i] >> 8)};
+        }
+    }
+
+    if (format_ == CaptureFormat::Y4M) {
+        write("YUV4MPEG2 W" + std::to_string(CAPTURE_WIDTH) + " H" + std::to_string(CAPTURE_HEIGHT) +
+              " F60:1 Ip A1:1 C444\n");
+    }
+}
+
+void VideoCapture::addFrame(const Video &video, uint64_t dirtyRows) {
+    // Dirty rows may have been drawn over and back, so they're compared to find the ones which really changed
+    uint64_t changedRows = 0;
+    if (framesAdded_ == 0 || video.width != previous_.width) {
+        changedRows = allRows(video.height);
+    } else {
+        for (auto rows = dirtyRows & allRows(video.height); rows != 0; rows &= rows - 1) {
+            const auto row = static_cast<unsigned int>(__builtin_ctzll(rows));
+            for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                if (video.planes[plane][row] != previous_.planes[plane][row]) {
+                    changedRows |= uint64_t{1} << row;
+                    break;
+                }
+            }
+        }
+    }
+
+    framesAdded_++;
+    if (changedRows == 0) {
+        heldFrames_++;
+        return;
+    }
+
+    writeHeldFrame();
+    for (auto rows = changedRows; rows != 0; rows &= rows - 1) {
+        convertRow(video, static_cast<unsigned int>(__builtin_ctzll(rows)));
+    }
+    previous_ = video;
+    heldFrames_ = 1;
+}
+
+void VideoCapture::finish() {
+    writeHeldFrame();
+    heldFrames_ = 0;
+    flush();
+    out_->flush();
+    if (!*out_) {
+        throw std::runtime_error("Failed to write the captured video");
+    }
+}
+
+unsigned int VideoCapture::framesAdded() const {
+    return framesAdded_;
+}
+
+unsigned int VideoCapture::framesWritten() const {
+    return framesWritten_;
+}
+
+void VideoCapture::convertRow(const Video &video, unsigned int row) {
+    const unsigned int scale = CAPTURE_WIDTH / video.width;
+    const std::size_t planeSize = CAPTURE_WIDTH * CAPTURE_HEIGHT;
+
+    for (unsigned int x = 0; x < video.width; x++) {
+        unsigned int colour = 0;
+        for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+            colour |= static_cast<unsigned int>(video.planes[plane][row][x / 64] >> (63 - x % 64) & 1) << plane;
+        }
+        const auto &components = colours_[colour];
+
+        for (unsigned int y = row * scale; y < (row + 1) * scale; y++) {
+            for (unsigned int i = x * scale; i < (x + 1) * scale; i++) {
+                const std::size_t pixel = y * CAPTURE_WIDTH + i;
+                if (format_ == CaptureFormat::Y4M) {
+                    frame_[pixel] = components[0];
+                    frame_[planeSize + pixel] = components[1];
+                    frame_[planeSize * 2 + pixel] = components[2];
+                } else {
+                    std::memcpy(&frame_[pixel * 3], components.data(), 3);
+                }
+            }
+        }
+    }
+}
+
+void VideoCapture::writeHeldFrame() {
+    if (heldFrames_ == 0) {
+        return;
+    }
+
+    std::string header;
+    if (format_ == CaptureFormat::Y4M) {
+        header = skipDuplicates_ ? "FRAME XLENGTH=" + std::to_string(heldFrames_) + "\n" : "FRAME\n";
+    } else {
+        header = "P6\n" + (skipDuplicates_ ? "# length " + std::to_string(heldFrames_) + "\n" : "") +
+                 std::to_string(CAPTURE_WIDTH) + " " + std::to_string(CAPTURE_HEIGHT) + "\n255\n";
+    }
+
+    for (unsigned int i = 0; i < (skipDuplicates_ ? 1 : heldFrames_); i++) {
+        write(header);
+        write(frame_.data(), frame_.size());
+        framesWritten_++;
+    }
+}
+
+void VideoCapture::write(const void *data, std::size_t size) {
+    if (buffered_ + size > buffer_.size()) {
+        flush();
+    }
+
+    if (size > buffer_.size()) {
+        out_->write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    } else {
+        std::memcpy(buffer_.data() + buffered_, data, size);
+        buffered_ += size;
+    }
+}
+
+void VideoCapture::write(const std::string &str) {
+    write(str.data(), str.size());
+}
+
+void VideoCapture::flush() {
+    out_->write(buffer_.data(), static_cast<std::streamsize>(buffered_));
+    buffered_ = 0;
+
+    if (!*out_) {
+        throw std::runtime_error("Failed to write the captured video");
+    }
+}
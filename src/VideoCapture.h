@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "Video.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Frames are always captured at the high resolution, with low resolution pixels doubled, so that their size never
+// changes within a stream
+const unsigned int CAPTURE_WIDTH = HIRES_VIDEO_WIDTH;
+const unsigned int CAPTURE_HEIGHT = HIRES_VIDEO_HEIGHT;
+
+// Frames are gathered into a buffer of this size and written in one go
+const std::size_t CAPTURE_BUFFER_SIZE = 1024 * 1024;
+
+// Writes the screen as a stream of uncompressed frames at 60 frames per second, to be encoded offline. Only the rows
+// which changed since the previous frame are converted, and a run of identical frames is held back until it ends, so
+// that it can be written as one frame tagged with its length.
+class VideoCapture {
+public:
+    // A path of "-" writes to stdout. With skipDuplicates, every run of identical frames is written as its first
+    // frame, tagged with the number of frames it lasts: "FRAME XLENGTH=<frames>" in Y4M, and a "# length <frames>"
+    // comment in PPM. Otherwise the run is written out frame by frame.
+    VideoCapture(const std::string &path, CaptureFormat format, bool skipDuplicates, const Palette &palette = PALETTE);
+
+    // Adds the next frame. Rows outside of dirtyRows must be the same as in the previous frame.
+    void addFrame(const Video &video, uint64_t dirtyRows);
+
+    // Writes out the frames held back and the buffer. Must be called after the last frame.
+    void finish();
+
+    [[nodiscard]] unsigned int framesAdded() const;
+
+    [[nodiscard]] unsigned int framesWritten() const;
+
+private:
+    // Converts a row of the screen into the rows of the frame it covers
+    void convertRow(const Video &video, unsigned int row);
+
+    // Writes the frame held back, either once or as many times as it lasts
+    void writeHeldFrame();
+
+    void write(const void *data, std::size_t size);
+
+    void write(const std::string &str);
+
+    void flush();
+
+    std::ofstream file_;
+    std::ostream *out_;
+
+    const CaptureFormat format_;
+    const bool skipDuplicates_;
+
+    // Components of each colour of the palette: Y, U and V for Y4M, and R, G and B for PPM
+    std::array<std::array<uint8_t, 3>, 1 << PLANE_COUNT> colours_;
+
+    Video previous_;
+    std::vector<uint8_t> frame_; // The converted frame, as written after its header
+    unsigned int heldFrames_; // Length of the run of identical frames which hasn't been written yet
+
+    std::vector<char> buffer_;
+    std::size_t buffered_;
+
+    unsigned int framesAdded_;
+    unsigned int framesWritten_;
+};
@@ -0,0 +1,292 @@
+#include "Chip8.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Translates a ROM into a C++ source file, which is linked into the emulator and run with the AOT engine.
+// Every instruction reachable from the start of the ROM becomes a labelled block of code. Jumps and calls with a
+// known target go straight to their label, everything else goes through a switch on the pc. Addresses which can't be
+// discovered statically, such as the targets of BNNN or returns into code outside the ROM, are left to the interpreter.
+
+const char *opName(Op op) {
+    switch (op) {
+        case Op::OPCODE_00E0: return "OPCODE_00E0";
+        case Op::OPCODE_00EE: return "OPCODE_00EE";
+        case Op::OPCODE_00CN: return "OPCODE_00CN";
+        case Op::OPCODE_00DN: return "OPCODE_00DN";
+        case Op::OPCODE_00FB: return "OPCODE_00FB";
+        case Op::OPCODE_00FC: return "OPCODE_00FC";
+        case Op::OPCODE_00FD: return "OPCODE_00FD";
+        case Op::OPCODE_00FE: return "OPCODE_00FE";
+        case Op::OPCODE_00FF: return "OPCODE_00FF";
+        case Op::OPCODE_1NNN: return "OPCODE_1NNN";
+        case Op::OPCODE_2NNN: return "OPCODE_2NNN";
+        case Op::OPCODE_3XNN: return "OPCODE_3XNN";
+        case Op::OPCODE_4XNN: return "OPCODE_4XNN";
+        case Op::OPCODE_5XY0: return "OPCODE_5XY0";
+        case Op::OPCODE_5XY2: return "OPCODE_5XY2";
+        case Op::OPCODE_5XY3: return "OPCODE_5XY3";
+        case Op::OPCODE_6XNN: return "OPCODE_6XNN";
+        case Op::OPCODE_7XNN: return "OPCODE_7XNN";
+        case Op::OPCODE_8XY0: return "OPCODE_8XY0";
+        case Op::OPCODE_8XY1: return "OPCODE_8XY1";
+        case Op::OPCODE_8XY2: return "OPCODE_8XY2";
+        case Op::OPCODE_8XY3: return "OPCODE_8XY3";
+        case Op::OPCODE_8XY4: return "OPCODE_8XY4";
+        case Op::OPCODE_8XY5: return "OPCODE_8XY5";
+        case Op::OPCODE_8XY6: return "OPCODE_8XY6";
+        case Op::OPCODE_8XY7: return "OPCODE_8XY7";
+        case Op::OPCODE_8XYE: return "OPCODE_8XYE";
+        case Op::OPCODE_9XY0: return "OPCODE_9XY0";
+        case Op::OPCODE_ANNN: return "OPCODE_ANNN";
+        case Op::OPCODE_BNNN: return "OPCODE_BNNN";
+        case Op::OPCODE_CXNN: return "OPCODE_CXNN";
+        case Op::OPCODE_DXYN: return "OPCODE_DXYN";
+        case Op::OPCODE_EX9E: return "OPCODE_EX9E";
+        case Op::OPCODE_EXA1: return "OPCODE_EXA1";
+        case Op::OPCODE_F000: return "OPCODE_F000";
+        case Op::OPCODE_FN01: return "OPCODE_FN01";
+        case Op::OPCODE_F002: return "OPCODE_F002";
+        case Op::OPCODE_FX07: return "OPCODE_FX07";
+        case Op::OPCODE_FX0A: return "OPCODE_FX0A";
+        case Op::OPCODE_FX15: return "OPCODE_FX15";
+        case Op::OPCODE_FX18: return "OPCODE_FX18";
+        case Op::OPCODE_FX1E: return "OPCODE_FX1E";
+        case Op::OPCODE_FX29: return "OPCODE_FX29";
+        case Op::OPCODE_FX30: return "OPCODE_FX30";
+        case Op::OPCODE_FX33: return "OPCODE_FX33";
+        case Op::OPCODE_FX3A: return "OPCODE_FX3A";
+        case Op::OPCODE_FX55: return "OPCODE_FX55";
+        case Op::OPCODE_FX65: return "OPCODE_FX65";
+        case Op::OPCODE_FX75: return "OPCODE_FX75";
+        case Op::OPCODE_FX85: return "OPCODE_FX85";
+        default: return "UNKNOWN";
+    }
+}
+
+std::string label(unsigned int address) {
+    std::ostringstream ss;
+    ss << "a" << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << address;
+    return ss.str();
+}
+
+std::string hex(unsigned int value, int width) {
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(width) << value;
+    return ss.str();
+}
+
+class Translator {
+public:
+    explicit Translator(std::vector<uint8_t> rom) : rom_{std::move(rom)} {}
+
+    // Follows every path from the start of the ROM, recording each address an instruction is executed from
+    void discover() {
+        std::vector<unsigned int> pending{ROM_START_ADDRESS};
+
+        while (!pending.empty()) {
+            const auto address = pending.back();
+            pending.pop_back();
+
+            if (!inRom(address) || !discovered_.insert(address).second) {
+                continue;
+            }
+
+            const auto instruction = fetch(address);
+            switch (instruction.op) {
+                case Op::OPCODE_1NNN:
+                    pending.push_back(instruction.nnn);
+                    break;
+                case Op::OPCODE_2NNN:
+                    // The call usually returns to the next instruction
+                    pending.push_back(instruction.nnn);
+                    pending.push_back(address + 2);
+                    break;
+                case Op::OPCODE_3XNN:
+                case Op::OPCODE_4XNN:
+                case Op::OPCODE_5XY0:
+                case Op::OPCODE_9XY0:
+                case Op::OPCODE_EX9E:
+                case Op::OPCODE_EXA1:
+                    pending.push_back(address + 2);
+                    pending.push_back(address + 4);
+                    if (skipsLongLoad(address)) {
+                        pending.push_back(address + 6);
+                    }
+                    break;
+                case Op::OPCODE_F000:
+                    pending.push_back(address + 4);
+                    break;
+                case Op::OPCODE_00EE:
+                case Op::OPCODE_BNNN:
+                case Op::UNKNOWN:
+                    // The next address isn't known until run time
+                    break;
+                case Op::OPCODE_00FD:
+                    // Nothing runs after the interpreter exits
+                    break;
+                default:
+                    pending.push_back(address + 2);
+                    break;
+            }
+        }
+    }
+
+    void write(std::ostream &os, const std::string &romName) const {
+        os << "// Translated from " << romName << " by chip8_aot. Do not edit.\n\n"
+           << "#include \"AotRuntime.h\"\n\n"
+           << "namespace {\n"
+           << "const uint8_t ROM[] = {";
+        for (std::size_t i = 0; i < rom_.size(); i++) {
+            os << (i % 16 == 0 ? "\n        " : " ") << hex(rom_[i], 2) << ",";
+        }
+        os << "\n};\n\n"
+           << "const uint8_t CODE[] = {";
+        for (std::size_t i = 0; i < rom_.size(); i++) {
+            const auto address = ROM_START_ADDRESS + static_cast<unsigned int>(i);
+            const bool code = discovered_.count(address) != 0 || discovered_.count(address - 1) != 0;
+            os << (i % 32 == 0 ? "\n        " : " ") << (code ? "1" : "0") << ",";
+        }
+        os << "\n};\n\n"
+           // Chip8::execute is too big to be inlined everywhere by default, but every call here has a constant
+           // instruction, which reduces it to the code of a single case once inlined
+           << "[[gnu::flatten]] unsigned int run(Chip8 &chip8, unsigned int cycles) {\n"
+           << "    unsigned int executed = 0;\n\n"
+           << "    dispatch:\n"
+           << "    if (executed == cycles) {\n"
+           << "        return executed;\n"
+           << "    }\n"
+           << "    switch (AotRuntime::entry(chip8)) {\n";
+        for (auto address : discovered_) {
+            os << "        case " << hex(address, 3) << ": goto " << label(address) << ";\n";
+        }
+        os << "        default: return executed;\n"
+           << "    }\n";
+
+        for (auto address : discovered_) {
+            writeInstruction(os, address);
+        }
+
+        os << "}\n\n"
+           << "const AotProgram PROGRAM{ROM, sizeof(ROM), CODE, run};\n"
+           << "[[maybe_unused]] const bool REGISTERED = registerAotProgram(PROGRAM);\n"
+           << "}\n";
+    }
+
+    [[nodiscard]] std::size_t instructionCount() const {
+        return discovered_.size();
+    }
+
+private:
+    [[nodiscard]] bool inRom(unsigned int address) const {
+        return address >= ROM_START_ADDRESS && address + 1 < ROM_START_ADDRESS + rom_.size();
+    }
+
+    [[nodiscard]] Instruction fetch(unsigned int address) const {
+        return decode(rom_[address - ROM_START_ADDRESS] << 8 | rom_[address + 1 - ROM_START_ADDRESS]);
+    }
+
+    // Skips jump over the whole of F000 NNNN when it's the next instruction
+    [[nodiscard]] bool skipsLongLoad(unsigned int address) const {
+        return inRom(address + 2) && fetch(address + 2).op == Op::OPCODE_F000;
+    }
+
+    // Goes straight to the label of a translated address, or back through the switch otherwise
+    [[nodiscard]] std::string jump(unsigned int address) const {
+        return "goto " + (discovered_.count(address) != 0 ? label(address) : "dispatch") + ";";
+    }
+
+    void writeInstruction(std::ostream &os, unsigned int address) const {
+        const auto instruction = fetch(address);
+        const auto opcode = rom_[address - ROM_START_ADDRESS] << 8 | rom_[address + 1 - ROM_START_ADDRESS];
+
+        os << "\n    " << label(address) << ": // " << hex(opcode, 4) << "\n"
+           << "    executed += AotRuntime::execute(chip8, {Op::" << opName(instruction.op) << ", "
+           << hex(instruction.x, 1) << ", " << hex(instruction.y, 1) << ", " << hex(instruction.n, 1) << ", "
+           << hex(instruction.nn, 2) << ", " << hex(instruction.nnn, 3) << "});\n"
+           // Stop once the requested number of instructions has run, and look up every address in the switch while
+           // any translated instruction is overwritten. Data which is written leaves the translation as it is.
+           << "    if (executed == cycles || AotRuntime::modified(chip8)) {\n"
+           << "        goto dispatch;\n"
+           << "    }\n";
+
+        switch (instruction.op) {
+            case Op::OPCODE_1NNN:
+            case Op::OPCODE_2NNN:
+                os << "    " << jump(instruction.nnn) << "\n";
+                break;
+            case Op::OPCODE_3XNN:
+            case Op::OPCODE_4XNN:
+            case Op::OPCODE_5XY0:
+            case Op::OPCODE_9XY0:
+            case Op::OPCODE_EX9E:
+            case Op::OPCODE_EXA1:
+                os << "    if (AotRuntime::pc(chip8) == " << hex(address + 4, 3) << ") {\n"
+                   << "        " << jump(address + 4) << "\n"
+                   << "    }\n";
+                if (skipsLongLoad(address)) {
+                    os << "    if (AotRuntime::pc(chip8) == " << hex(address + 6, 3) << ") {\n"
+                       << "        " << jump(address + 6) << "\n"
+                       << "    }\n";
+                }
+                os << "    " << jump(address + 2) << "\n";
+                break;
+            case Op::OPCODE_F000:
+                os << "    " << jump(address + 4) << "\n";
+                break;
+            case Op::OPCODE_00EE:
+            case Op::OPCODE_00FD:
+            case Op::OPCODE_BNNN:
+            case Op::OPCODE_FX0A:
+            case Op::UNKNOWN:
+                // 00FD, FX0A and unknown opcodes may leave the pc where it is
+                os << "    goto dispatch;\n";
+                break;
+            default:
+                os << "    " << jump(address + 2) << "\n";
+                break;
+        }
+    }
+
+    const std::vector<uint8_t> rom_;
+    std::set<unsigned int> discovered_;
+};
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <rom> <output.cpp>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream ifs(argv[1], std::ios::binary);
+    if (!ifs) {
+        std::cerr << "Can't open file: " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (rom.empty() || rom.size() > MEMORY_SIZE - ROM_START_ADDRESS) {
+        std::cerr << "ROM must be between 1 and " << MEMORY_SIZE - ROM_START_ADDRESS << " bytes long\n";
+        return EXIT_FAILURE;
+    }
+
+    Translator translator{rom};
+    translator.discover();
+
+    std::ofstream ofs(argv[2]);
+    if (!ofs) {
+        std::cerr << "Can't open file: " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+    translator.write(ofs, std::filesystem::path(argv[1]).filename().string());
+
+    std::cout << "Translated " << translator.instructionCount() << " instructions from " << argv[1] << "\n";
+
+    return EXIT_SUCCESS;
+}
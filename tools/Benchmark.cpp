@@ -0,0 +1,328 @@
+#include "Chip8.h"
+#include "Upscale.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Measures the instructions per second of each engine on a set of ROMs. Runs headless, so no SDL is needed.
+// With --lockstep, each engine is instead run side by side with the reference engine, and the whole machine state is
+// compared after every slice of instructions. With --filters, the screens the ROMs end up with are instead scaled by
+// each filter, with and without SIMD, to the size of a window at the default scale.
+
+const unsigned int CYCLES_PER_TIMER_TICK = 1000 / TIMER_FREQUENCY;
+const unsigned int SEED = 0;
+
+// Size of the window at the default scale of 15
+const unsigned int FILTER_AREA_WIDTH = VIDEO_WIDTH * 15;
+const unsigned int FILTER_AREA_HEIGHT = VIDEO_HEIGHT * 15;
+const unsigned int FILTER_REPEATS = 20;
+
+struct Result {
+    double instructionsPerSecond;
+    Video video;
+};
+
+Result run(const std::string &romPath, Engine engine, unsigned int cycles) {
+    Chip8 chip8{Mode::SCHIP, 0, engine, CYCLES_PER_TIMER_TICK};
+    chip8.seed(SEED);
+    chip8.loadRom(romPath);
+
+    auto start = std::chrono::steady_clock::now();
+    chip8.run(cycles);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return {static_cast<double>(cycles) / elapsed.count(), chip8.video()};
+}
+
+struct LockstepResult {
+    bool diverged;
+    unsigned int executed; // Instructions executed when the engines diverged or stopped
+    std::string error; // Thrown by both engines, or by either one if they diverged
+};
+
+// The error a step threw, if it threw one
+template <typename Step>
+std::optional<std::string> tryStep(Step step) {
+    try {
+        step();
+    }
+    catch (const std::exception &e) {
+        return std::string{e.what()};
+    }
+    return std::nullopt;
+}
+
+// Runs the engine side by side with the reference engine. Slices have varying lengths and keys are toggled in between,
+// so that blocks get split in different places. Both engines throwing the same error at the same point, such as a ROM
+// being too big for the mode, stops the run without a divergence. Only one of them throwing is a divergence.
+LockstepResult lockstep(const std::string &romPath, Mode mode, Quirks quirks, Engine engine, unsigned int cycles) {
+    Chip8 reference{mode, quirks, Engine::TABLE, CYCLES_PER_TIMER_TICK};
+    Chip8 chip8{mode, quirks, engine, CYCLES_PER_TIMER_TICK};
+    reference.seed(SEED);
+    chip8.seed(SEED);
+
+    auto compare = [&reference, &chip8](unsigned int executed, const std::optional<std::string> &referenceError,
+                                        const std::optional<std::string> &error) -> std::optional<LockstepResult> {
+        if (referenceError != error) {
+            return LockstepResult{true, executed, error ? *error : *referenceError};
+        } else if (reference != chip8) {
+            return LockstepResult{true, executed, error ? *error : ""};
+        } else if (error) {
+            return LockstepResult{false, executed, *error};
+        }
+        return std::nullopt;
+    };
+
+    if (const auto result = compare(0, tryStep([&] { reference.loadRom(romPath); }),
+                                    tryStep([&] { chip8.loadRom(romPath); }))) {
+        return *result;
+    }
+
+    std::default_random_engine sliceEngine{SEED};
+    std::uniform_int_distribution<unsigned int> sliceLength{1, 100};
+    std::uniform_int_distribution<unsigned int> key{0, KEY_COUNT - 1};
+
+    unsigned int executed = 0;
+    while (executed < cycles) {
+        const auto slice = std::min(sliceLength(sliceEngine), cycles - executed);
+        const auto referenceError = tryStep([&] { reference.run(slice); });
+        const auto error = tryStep([&] { chip8.run(slice); });
+        executed += slice;
+
+        if (const auto result = compare(executed, referenceError, error)) {
+            return *result;
+        }
+
+        const auto toggled = key(sliceEngine);
+        reference.setKeys(reference.keys() ^ 1 << toggled);
+        chip8.setKeys(chip8.keys() ^ 1 << toggled);
+    }
+
+    return {false, executed, ""};
+}
+
+// Returns the average seconds it took to scale all the screens, which are written to pixels
+double timeFilter(Filter filter, bool simd, const std::vector<Video> &screens,
+                  const std::vector<VideoIndices> &indices, std::vector<std::vector<uint32_t>> &pixels) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int repeat = 0; repeat < FILTER_REPEATS; repeat++) {
+        for (std::size_t i = 0; i < screens.size(); i++) {
+            const auto &video = screens[i];
+            const auto scale = filterScale(filter, video.width, video.height, FILTER_AREA_WIDTH, FILTER_AREA_HEIGHT);
+            const auto pitch = static_cast<std::size_t>(video.width) * scale;
+            pixels[i].resize(pitch * video.height * scale);
+
+            const auto upscale = simd ? upscaleRows : upscaleRowsReference;
+            upscale(filter, indices[i], video.width, video.height, 0, video.height, scale, PALETTE, pixels[i].data(),
+                    pitch);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / FILTER_REPEATS;
+}
+
+int benchmarkFilters(const std::vector<std::string> &roms, unsigned int cycles) {
+    std::vector<Video> screens;
+    std::vector<VideoIndices> indices;
+    for (const auto &rom : roms) {
+        try {
+            screens.push_back(run(rom, Engine::SWITCH, cycles).video);
+        }
+        catch (const std::exception &e) {
+            std::cout << rom << ": " << e.what() << "\n";
+            continue;
+        }
+        indices.emplace_back();
+        indexVideoRows(screens.back(), 0, screens.back().height, indices.back());
+    }
+    if (screens.empty()) {
+        std::cerr << "No screens to scale\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << screens.size() << " screens scaled to fit " << FILTER_AREA_WIDTH << "*" << FILTER_AREA_HEIGHT << "\n";
+    std::cout << std::fixed << std::setprecision(1) << std::left << std::setw(12) << "Filter" << std::right
+              << std::setw(14) << "SIMD us" << std::setw(14) << "Scalar us" << std::setw(10) << "Speedup" << "\n";
+
+    const std::vector<std::pair<Filter, std::string>> filters{{Filter::NEAREST,   "nearest"},
+                                                              {Filter::SCALE2X,   "scale2x"},
+                                                              {Filter::SCALE3X,   "scale3x"},
+                                                              {Filter::SCANLINES, "scanlines"}};
+    bool mismatch = false;
+    std::vector<std::vector<uint32_t>> simdPixels(screens.size());
+    std::vector<std::vector<uint32_t>> referencePixels(screens.size());
+
+    for (const auto &filter : filters) {
+        const auto simdSeconds = timeFilter(filter.first, true, screens, indices, simdPixels);
+        const auto referenceSeconds = timeFilter(filter.first, false, screens, indices, referencePixels);
+
+        // Times are per screen
+        const auto count = static_cast<double>(screens.size());
+        std::cout << std::left << std::setw(12) << filter.second << std::right << std::setw(14)
+                  << simdSeconds / count * 1000000 << std::setw(14) << referenceSeconds / count * 1000000
+                  << std::setw(9) << std::setprecision(2) << referenceSeconds / simdSeconds << "x"
+                  << std::setprecision(1);
+
+        // The SIMD kernels must produce exactly the same pixels as the scalar ones
+        if (simdPixels != referencePixels) {
+            std::cout << " MISMATCH";
+            mismatch = true;
+        }
+        std::cout << "\n";
+    }
+
+    return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    std::string romDir = "bin/roms/revival";
+    unsigned int cycles = 2000000;
+    bool checkLockstep = false;
+    bool filters = false;
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--lockstep") {
+        checkLockstep = true;
+        args.erase(args.begin());
+    } else if (!args.empty() && args[0] == "--filters") {
+        filters = true;
+        args.erase(args.begin());
+    }
+
+    if (!args.empty()) {
+        romDir = args[0];
+    }
+    if (args.size() > 1) {
+        std::string cyclesStr = args[1];
+        if (static_cast<bool>(std::from_chars(cyclesStr.data(), cyclesStr.data() + cyclesStr.size(), cycles).ec)) {
+            std::cerr << "Usage: " << argv[0] << " [--lockstep | --filters] [rom directory] [instructions per ROM]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::string> roms;
+    try {
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(romDir)) {
+            if (entry.path().extension() == ".ch8") {
+                roms.push_back(entry.path().string());
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::sort(roms.begin(), roms.end());
+
+    std::vector<std::pair<Engine, std::string>> engines{{Engine::TABLE,  "table"},
+                                                        {Engine::SWITCH, "switch"},
+                                                        {Engine::BLOCK,  "block"}};
+    if (JIT_SUPPORTED) {
+        engines.emplace_back(Engine::JIT, "jit");
+    }
+    if (aotProgramCount() > 0) {
+        engines.emplace_back(Engine::AOT, "aot");
+
+        // Only ROMs translated by chip8_aot are benchmarked, so that every engine runs the same set
+        roms.erase(std::remove_if(roms.begin(), roms.end(), [](const std::string &rom) {
+            std::ifstream ifs(rom, std::ios::binary);
+            std::vector<uint8_t> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            return findAotProgram(contents.data(), contents.size()) == nullptr;
+        }), roms.end());
+    }
+
+    if (filters) {
+        return benchmarkFilters(roms, cycles);
+    }
+
+    if (checkLockstep) {
+        bool diverged = false;
+
+        // Check the default profile, the one with the most quirks enabled, and the XO-CHIP
+        const std::vector<std::pair<Mode, Quirks>> profiles{{Mode::SCHIP, 0},
+                                                            {Mode::CHIP8, RUNTIME_QUIRKS - 1},
+                                                            {Mode::XOCHIP, 0}};
+
+        for (const auto &rom : roms) {
+            for (const auto &profile : profiles) {
+                for (std::size_t i = 1; i < engines.size(); i++) {
+                    try {
+                        const auto result = lockstep(rom, profile.first, profile.second, engines[i].first, cycles);
+                        if (result.diverged) {
+                            std::cout << rom << ": " << engines[i].second << " engine diverged after "
+                                      << result.executed << " instructions with quirks " << profile.second
+                                      << (result.error.empty() ? "" : ": " + result.error) << "\n";
+                            diverged = true;
+                        } else if (!result.error.empty() && i == 1) {
+                            // Every engine stops at the same point, so this is only reported once
+                            std::cout << rom << ": skipped with quirks " << profile.second << ": " << result.error
+                                      << "\n";
+                        }
+                    }
+                    catch (const std::exception &e) {
+                        std::cout << rom << ": " << engines[i].second << " engine failed: " << e.what() << "\n";
+                        diverged = true;
+                    }
+                }
+            }
+        }
+
+        std::cout << (diverged ? "Engines diverged" : "All engines matched the reference engine") << "\n";
+        return diverged ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << std::left << std::setw(64) << "ROM";
+    for (const auto &engine : engines) {
+        std::cout << std::right << std::setw(13) << engine.second + " MIPS";
+    }
+    std::cout << "\n";
+
+    std::vector<double> totalSeconds(engines.size(), 0);
+    bool mismatch = false;
+
+    for (const auto &rom : roms) {
+        std::cout << std::left << std::setw(64) << std::filesystem::path(rom).filename().string().substr(0, 63);
+
+        std::vector<Result> results;
+        try {
+            for (const auto &engine : engines) {
+                results.push_back(run(rom, engine.first, cycles));
+            }
+        }
+        catch (const std::exception &e) {
+            std::cout << e.what() << "\n";
+            continue;
+        }
+
+        for (std::size_t i = 0; i < results.size(); i++) {
+            std::cout << std::right << std::setw(13) << results[i].instructionsPerSecond / 1000000;
+            totalSeconds[i] += cycles / results[i].instructionsPerSecond;
+
+            // Every engine must end up with the same screen as the reference engine
+            if (results[i].video != results[0].video) {
+                std::cout << " MISMATCH";
+                mismatch = true;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\nSpeedup over " << engines[0].second << " engine:";
+    for (std::size_t i = 1; i < engines.size(); i++) {
+        std::cout << " " << engines[i].second << " " << std::setprecision(2) << totalSeconds[0] / totalSeconds[i]
+                  << "x";
+    }
+    std::cout << "\n";
+
+    return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+#include "SharedFrames.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <bitset>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Example of reading the frames the emulator exports with --export from another process. Follows the frames as they
+// come, and prints the ones which changed, with how many pixels are on, read straight out of the shared memory.
+
+// Gives up once no frame has come for this long, e.g. because the emulator quit
+const std::chrono::seconds IDLE_TIMEOUT{2};
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <name> [frames]\n"
+                  << "Prints the frames the emulator exports to the shared memory of the given name with --export.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string name = argv[1];
+    if (name[0] != '/') {
+        name = "/" + name;
+    }
+
+    uint64_t framesToRead = UINT64_MAX;
+    if (argc > 2) {
+        std::from_chars(argv[2], argv[2] + std::strlen(argv[2]), framesToRead);
+    }
+
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "Can't open shared memory " << name << ". " << std::strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    void *memory = mmap(nullptr, sizeof(SharedFrames), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Can't map shared memory " << name << ". " << std::strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    const auto &shared = *static_cast<const SharedFrames *>(memory);
+
+    auto lastFrameTime = std::chrono::steady_clock::now();
+    uint64_t next = 0;
+    uint64_t read = 0;
+    uint64_t missed = 0;
+    bool started = false;
+
+    while (read < framesToRead && std::chrono::steady_clock::now() - lastFrameTime < IDLE_TIMEOUT) {
+        const auto written = shared.framesWritten.load(std::memory_order_acquire);
+        if (written == 0 || written <= next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // The header is complete once the first frame is out
+        if (!started) {
+            if (shared.magic != SHARED_FRAMES_MAGIC || shared.version != SHARED_FRAMES_VERSION) {
+                std::cerr << name << " doesn't hold frames exported by this version of the emulator\n";
+                return EXIT_FAILURE;
+            }
+            started = true;
+            next = written - 1;
+        }
+
+        // Frames which were overwritten before this reader got to them are skipped
+        if (written - next > SHARED_FRAME_SLOTS) {
+            missed += written - next - 1;
+            next = written - 1;
+        }
+
+        uint64_t sequence;
+        const auto *frame = beginSharedFrameRead(shared, next, sequence);
+        if (!frame) {
+            missed++;
+            next++;
+            continue;
+        }
+
+        const auto dirtyRows = frame->dirtyRows;
+        const auto keys = frame->keys;
+        const auto width = frame->width;
+        const auto height = frame->height;
+        std::size_t pixelsOn = 0;
+        for (const auto &row : frame->planes[0]) {
+            for (auto word : row) {
+                pixelsOn += std::bitset<64>(word).count();
+            }
+        }
+
+        if (!endSharedFrameRead(*frame, sequence)) {
+            missed++;
+            next++;
+            continue;
+        }
+
+        if (dirtyRows != 0) {
+            std::cout << "Frame " << next << ": " << width << "x" << height << ", "
+                      << std::bitset<64>(dirtyRows).count() << " rows changed, " << pixelsOn << " pixels on, keys 0x"
+                      << std::hex << std::setw(4) << std::setfill('0') << keys << std::dec << "\n";
+        }
+
+        lastFrameTime = std::chrono::steady_clock::now();
+        read++;
+        next++;
+    }
+
+    std::cout << "Read " << read << " frames, missed " << missed << "\n";
+    munmap(memory, sizeof(SharedFrames));
+    return EXIT_SUCCESS;
+}